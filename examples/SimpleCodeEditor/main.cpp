@@ -30,8 +30,10 @@ int main(int argc, char* argv[])
     QApplication app(argc, argv);
 
     QCodeEditor* codeEditor = new QCodeEditor();
+    codeEditor->beginConfiguration();
     codeEditor->setDesign(QCodeEditorDesign(":/design.xml"));
     codeEditor->setRules(QSyntaxRules::loadFromFile(":/rules.xml", codeEditor->design()));
+    codeEditor->commitConfiguration();
 
     QGridLayout* gridLayout = new QGridLayout();
     gridLayout->addWidget(codeEditor);
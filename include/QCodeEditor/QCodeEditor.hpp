@@ -32,6 +32,11 @@ class QDialog;
 class QSortFilterProxyModel;
 class QStandardItemModel;
 
+class QCodeEditorChangeTracker;
+class QCodeEditorCompleter;
+class QCodeEditorCompletionModel;
+class QCodeEditorKeywordProvider;
+class QCodeEditorWordProvider;
 class QCodeEditorLineWidget;
 class QCodeEditorHighlighter;
 class QCodeEditorPopup;
@@ -81,17 +86,50 @@ public:
     QCodeEditorHighlighter* highlighter() const;
 
     /**
-     * Specifies the syntax highlighting rules.
+     * @brief Retrieves the tracker collecting the changed ranges.
+     * Unlike lineChanged(), it reports every changed range and coalesces
+     * the notifications.
+     * @return The change tracker of the document.
+     */
+    QCodeEditorChangeTracker* changeTracker() const;
+
+    /**
+     * @brief Specifies the syntax highlighting rules.
+     * Only the lines affected by changed rules are highlighted again, see
+     * QCodeEditorHighlighter::reloadRules().
      * @param rules List of sntax rules.
      */
     void setRules(const QList<QSyntaxRule>& rules);
 
     /**
-     * Specifies the visual properties.
+     * @brief Specifies the visual properties.
+     * Highlighted lines take over the new design right away, without being
+     * highlighted again.
      * @param design A structure containing visual properties.
      */
     void setDesign(const QCodeEditorDesign& design);
 
+    /**
+     * @brief Defers the effects of setDesign(), setRules() and setKeywords().
+     * Until the matching commitConfiguration(), the settings are only
+     * stored. The commit then builds the formats once, applies the style
+     * sheet once, sorts the keywords once and highlights the document once.
+     * Calls can be nested; only the outermost commit applies the settings.
+     */
+    void beginConfiguration();
+
+    /**
+     * @brief Applies all settings made since beginConfiguration().
+     * Does nothing if a surrounding configuration is still open.
+     */
+    void commitConfiguration();
+
+    /**
+     * Determines whether a configuration is open.
+     * @return True if settings are deferred.
+     */
+    bool isConfiguring() const;
+
     /**
      * @brief Sets the completion trigger.
      * Specifies the amount of characters to be typed in the currently written
@@ -102,25 +140,57 @@ public:
 
     /**
      * @brief Specifies the keywords for auto-completion.
-     * The keywords are sorted alphabetically. If you want to add icons or other
-     * things to the keywords, you have to specify a custom model through
-     * setKeywordModel().
+     * The keywords are added to the existing ones and sorted alphabetically,
+     * so that the completions of a word are found by a binary search. If you
+     * want to add icons or other things to the keywords, you have to specify
+     * a custom model through setKeywordModel().
      * @param keywords List of keywords.
      */
     void setKeywords(const QStringList& keywords);
 
     /**
-     * Specifies the auto-complete model directly.
-     * @param model QStandardItemModel to use.
+     * @brief Specifies the auto-complete model directly.
+     * Custom models are filtered row by row, which is slower than the
+     * built-in keywords for large amounts of keywords.
+     * @param model QStandardItemModel to use or nullptr for the keywords.
      */
     void setKeywordModel(QStandardItemModel* model);
 
+    /**
+     * Retrieves the model holding the keywords for auto-completion.
+     * @return The sorted keyword index.
+     */
+    QCodeEditorCompletionModel* completionModel() const;
+
+    /**
+     * @brief Retrieves the completer feeding the auto-complete popup.
+     * Further QCodeEditorCompletionProvider instances can be added to it;
+     * the keywords of completionModel() are always the first provider.
+     * @return The completer of the editor.
+     */
+    QCodeEditorCompleter* completer() const;
+
+    /**
+     * @brief Retrieves the provider completing identifiers of the document.
+     * It follows the keywords within the completer; remove it from there
+     * to only complete keywords.
+     * @return The word provider of the editor.
+     */
+    QCodeEditorWordProvider* wordProvider() const;
+
     /**
      * Adds a keyword to the existing model.
      * @param keyword New auto-complete keyword.
      */
     void addKeyword(const QString& keyword);
 
+    /**
+     * @brief Adds keywords that do not exist yet to the existing model.
+     * Sorts once for all keywords; much faster than adding them one by one.
+     * @param keywords New auto-complete keywords.
+     */
+    void addKeywords(const QStringList& keywords);
+
     /**
      * @brief Removes a keyword from the existing model.
      * @param keyword Keyword to remove from the list.
@@ -128,6 +198,13 @@ public:
     void removeKeyword(const QString& keyword);
 
     /**
+     * @brief Removes keywords from the existing model.
+     * @param keywords Keywords to remove from the list.
+     */
+    void removeKeywords(const QStringList& keywords);
+
+    /**
+     * Checks in constant time whether a keyword exists.
      * @param keyword Keyword to check.
      * @return True if the keyword exists.
      */
@@ -137,6 +214,7 @@ public:
      * @brief Applies syntax highlighting manually.
      * Normally one would not need this, because 'setRules'
      * already performs rehighlighting of the QCodeEditor.
+     * Respects the highlighting mode of the highlighter.
      */
     void rehighlight();
 
@@ -158,28 +236,53 @@ protected:
     void resizeEvent(QResizeEvent*) Q_DECL_OVERRIDE;
 
 signals:
+
+    /**
+     * @brief Will fire on every change with the block of the cursor.
+     * Does not describe the changed range; see changeTracker().
+     * @param block Block containing the cursor.
+     */
     void lineChanged(QTextBlock block);
 
 private slots:
     void updateLineColumn(int lineCount);
     void scrollLineColumn(QRect view, int scroll);
     void completeWord(const QString& word);
+    void saveCompletion();
+    void showCompletions();
     void textChanged();
 
 private:
+    void updateDesign();
+    void updateKeywordModel();
+
     QList<QSyntaxRule> _rules;
     QCodeEditorDesign _design;
     QCodeEditorLineWidget* _lineWidget;
     QCodeEditorPopup* _popup;
     QCodeEditorHighlighter* _highlighter;
-    QStandardItemModel* _sourceModel;
+    QCodeEditorCompletionModel* _completionModel;
+    QCodeEditorCompleter* _completer;
+    QCodeEditorKeywordProvider* _keywordProvider;
+    QStandardItemModel* _keywordModel;
     QSortFilterProxyModel* _ruleFilter;
     QCompleter* _autoComplete;
     qint32 _completionTrigger;
     QDialog* _textFinder;
+    QCodeEditorChangeTracker* _changeTracker;
+    QCodeEditorWordProvider* _wordProvider;
+    QString _currentCompletion;
+    int _configDepth;
+    bool _designPending;
+    bool _rulesPending;
+    bool _keywordsPending;
+    QList<QSyntaxRule> _pendingRules;
+    QStringList _pendingKeywords;
 
     // Allow the line widget to access vars/funcs while rendering
     friend class QCodeEditorLineWidget;
+    // Allow the highlighter to prioritize the visible blocks
+    friend class QCodeEditorHighlighter;
 
     Q_OBJECT
 };
@@ -0,0 +1,149 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef QCODEEDITOR_QCODEEDITORCHANGETRACKER_H
+#define QCODEEDITOR_QCODEEDITORCHANGETRACKER_H
+
+#include <QMetaType>
+#include <QObject>
+#include <QVector>
+
+#include <QCodeEditor/Config.hpp>
+
+class QCodeEditorHighlighter;
+class QTextDocument;
+class QTimer;
+
+/**
+ * Describes a range of the document that was changed.
+ * @class QCodeEditorChange
+ *
+ * The position and the removed characters refer to the document before
+ * the change, the added characters and the blocks to the document after it.
+ */
+struct QCodeEditorChange
+{
+    int position;     ///< Position of the change.
+    int charsRemoved; ///< Amount of characters removed at the position.
+    int charsAdded;   ///< Amount of characters added at the position.
+    int firstBlock;   ///< First block containing added text.
+    int lastBlock;    ///< Last block containing added text.
+    int blockDelta;   ///< Amount of blocks added (or removed, if negative).
+    quint64 revision; ///< Revision of the document after the change.
+};
+
+Q_DECLARE_METATYPE(QCodeEditorChange)
+
+/**
+ * Collects the changed ranges of a document.
+ * @class QCodeEditorChangeTracker
+ *
+ * Every change of the text increments the revision and is recorded as a
+ * QCodeEditorChange. Blocks formatted by the highlighter given with
+ * setHighlighter() are reported by the document as well, but do not change
+ * the text and are ignored. A change continuing the previous one, such as
+ * typing or deleting the text just typed, is merged into it. The collected
+ * changes are reported at most once per interval, so that listeners can
+ * update their state incrementally instead of rescanning the whole document.
+ */
+class QCODEEDITOR_API QCodeEditorChangeTracker : public QObject
+{
+public:
+    /**
+     * Tracks the changes of the given document.
+     * @param document Document to track.
+     * @param parent Parent of the tracker.
+     */
+    QCodeEditorChangeTracker(QTextDocument* document, QObject* parent = nullptr);
+
+    /**
+     * Retrieves the revision of the document's text.
+     * @return The amount of text changes since the tracker was created.
+     */
+    quint64 revision() const;
+
+    /**
+     * Retrieves the highlighter whose formatting is ignored.
+     * @return The highlighter; nullptr if there is none.
+     */
+    const QCodeEditorHighlighter* highlighter() const;
+
+    /**
+     * @brief Specifies the highlighter whose formatting is ignored.
+     * Without a highlighter, every change of the document is recorded.
+     * @param highlighter Highlighter of the document.
+     */
+    void setHighlighter(const QCodeEditorHighlighter* highlighter);
+
+    /**
+     * Retrieves the minimum time between two notifications.
+     * @return The interval in milliseconds.
+     */
+    int interval() const;
+
+    /**
+     * @brief Specifies the minimum time between two notifications.
+     * With 0, the changes are reported once per event loop iteration.
+     * @param ms The interval in milliseconds.
+     */
+    void setInterval(int ms);
+
+    /**
+     * Retrieves the changes that were not reported yet.
+     * @return The changes in the order they happened.
+     */
+    const QVector<QCodeEditorChange>& pendingChanges() const;
+
+public slots:
+
+    /**
+     * Reports the pending changes right away.
+     */
+    void flush();
+
+signals:
+
+    /**
+     * @brief Will fire at most once per interval if the document changed.
+     * Applying the changes in order transforms the document of the previous
+     * notification into the current one.
+     * @param changes Changes since the previous notification.
+     * @param revision Revision of the document after the last change.
+     */
+    void onChanged(const QVector<QCodeEditorChange>& changes, quint64 revision);
+
+private slots:
+    void contentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    bool merge(int position, int charsRemoved, int charsAdded, int blockDelta);
+    void updateBlocks(QCodeEditorChange& change) const;
+
+    QTextDocument* _document;
+    const QCodeEditorHighlighter* _highlighter;
+    QVector<QCodeEditorChange> _changes;
+    quint64 _revision;
+    int _blockCount;
+    QTimer* _timer;
+
+    Q_OBJECT
+};
+
+
+#endif
@@ -0,0 +1,149 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#ifndef QCODEEDITOR_QCODEEDITORCOMPLETER_H
+#define QCODEEDITOR_QCODEEDITORCOMPLETER_H
+
+#include <QAbstractListModel>
+#include <QList>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+#include <QCodeEditor/Config.hpp>
+
+class QTimer;
+
+class QCodeEditorCompletionProvider;
+
+/**
+ * Merges the completions of several providers into the rows of a model.
+ * @class QCodeEditorCompleter
+ *
+ * complete() waits for the debounce interval, then sends a request with a
+ * new identifier to all providers. The completions are merged in the order
+ * the providers were added; each completion is only listed once. Rows are
+ * inserted as the completions arrive, so that a view updates incrementally.
+ * The rows of the previous request stay until the first completions of the
+ * next one arrive. Asking for another word cancels the running request.
+ */
+class QCODEEDITOR_API QCodeEditorCompleter : public QAbstractListModel
+{
+public:
+    QCodeEditorCompleter(QObject* parent = nullptr);
+    ~QCodeEditorCompleter() = default;
+
+    /**
+     * @brief Adds a provider after the existing ones.
+     * The completer does not take ownership of the provider.
+     * @param provider Provider to ask for completions.
+     */
+    void addProvider(QCodeEditorCompletionProvider* provider);
+
+    /**
+     * Removes a provider; cancels the running request.
+     * @param provider Provider to remove.
+     */
+    void removeProvider(QCodeEditorCompletionProvider* provider);
+
+    /**
+     * Retrieves the providers in the order their completions are listed.
+     * @return List of providers.
+     */
+    const QList<QCodeEditorCompletionProvider*>& providers() const;
+
+    /**
+     * Retrieves the time waited before the providers are asked.
+     * @return The debounce interval in milliseconds.
+     */
+    int debounce() const;
+
+    /**
+     * @brief Specifies the time waited before the providers are asked.
+     * Words typed within the interval replace each other, so that slow
+     * providers are only asked for the last one. With 0, the providers are
+     * asked in the next event loop iteration.
+     * @param ms The debounce interval in milliseconds.
+     */
+    void setDebounce(int ms);
+
+    /**
+     * Retrieves the word that is completed.
+     * @return The word of the current request.
+     */
+    const QString& prefix() const;
+
+    /**
+     * Determines whether providers are still working on the current request.
+     * @return True if not all providers finished.
+     */
+    bool isRunning() const;
+
+    /**
+     * @brief Requests the completions of a word.
+     * Does nothing if the word is completed already.
+     * @param prefix Word under the cursor.
+     * @param position Position of the cursor within the document.
+     */
+    void complete(const QString& prefix, int position);
+
+    /**
+     * Cancels the current request and removes all rows.
+     */
+    void cancel();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
+
+signals:
+
+    /**
+     * @brief Will fire if completions of the current request arrived.
+     * Also fires once all providers finished.
+     * @param rowCount Amount of rows.
+     * @param finished True if all providers finished.
+     */
+    void onUpdated(int rowCount, bool finished);
+
+private slots:
+    void startRequest();
+    void receive(quint64 id, const QStringList& completions, bool finished);
+    void providerDestroyed(QObject* provider);
+
+private:
+    void abort();
+    void clearRows();
+
+    QList<QCodeEditorCompletionProvider*> _providers;
+    QSet<QCodeEditorCompletionProvider*> _running;
+    QVector<int> _counts;
+    QStringList _rows;
+    QSet<QString> _listed;
+    QString _prefix;
+    int _position;
+    quint64 _id;
+    quint64 _nextId;
+    bool _stale;
+    QTimer* _debounceTimer;
+
+    Q_OBJECT
+};
+
+#endif
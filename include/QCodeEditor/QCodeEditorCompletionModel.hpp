@@ -0,0 +1,206 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#ifndef QCODEEDITOR_QCODEEDITORCOMPLETIONMODEL_H
+#define QCODEEDITOR_QCODEEDITORCOMPLETIONMODEL_H
+
+#include <QAbstractListModel>
+#include <QSet>
+#include <QStringList>
+#include <QStringRef>
+#include <QVector>
+
+#include <QCodeEditor/Config.hpp>
+
+/**
+ * Provides the keywords starting with a prefix to the completer.
+ * @class QCodeEditorCompletionModel
+ *
+ * The keywords are kept sorted case-insensitively, so that all keywords
+ * starting with a prefix form a contiguous range. Changing the prefix
+ * binary-searches that range; the rows of the model are the keywords
+ * within it. No keyword is tested against a regex.
+ *
+ * All keywords are stored back to back in a single string, which avoids
+ * an allocation per keyword. A hash set referring into that string tells
+ * in constant time whether a keyword exists. Single keywords are inserted
+ * and removed in place; batches sort once and rebuild the set, which is
+ * faster for many keywords.
+ *
+ * In FuzzyMatch mode, the rows are the keywords containing the characters
+ * of the prefix in order, best matches first. Matches at the start of the
+ * keyword, after an underscore or at a camelCase hump score higher, just
+ * like consecutive characters. A mask of the characters contained in each
+ * keyword rules out most keywords with a single AND, and only the best
+ * matches are kept in a bounded heap.
+ */
+class QCODEEDITOR_API QCodeEditorCompletionModel : public QAbstractListModel
+{
+public:
+    /**
+     * Determines how the keywords are matched against the prefix.
+     */
+    enum MatchMode {
+        PrefixMatch, ///< Keywords starting with the prefix, in alphabetical order.
+        FuzzyMatch   ///< Keywords containing the prefix as subsequence, best first.
+    };
+
+    QCodeEditorCompletionModel(QObject* parent = nullptr);
+    ~QCodeEditorCompletionModel() = default;
+
+    /**
+     * Retrieves the amount of keywords, regardless of the prefix.
+     * @return Amount of keywords.
+     */
+    int keywordCount() const;
+
+    /**
+     * Retrieves a keyword without copying it.
+     * @param index Index of the keyword in case-insensitive order.
+     * @return Reference to the keyword; invalidated by the next change.
+     */
+    QStringRef keywordAt(int index) const;
+
+    /**
+     * Retrieves all keywords, regardless of the prefix.
+     * @return The keywords in case-insensitive order.
+     */
+    QStringList keywords() const;
+
+    /**
+     * @brief Replaces all keywords.
+     * Duplicates are only kept once.
+     * @param keywords List of keywords in any order.
+     */
+    void setKeywords(const QStringList& keywords);
+
+    /**
+     * @brief Adds keywords that do not exist yet.
+     * The new keywords are sorted and merged into the existing ones.
+     * @param keywords List of keywords in any order.
+     * @return Amount of keywords that were added.
+     */
+    int addKeywords(const QStringList& keywords);
+
+    /**
+     * Removes keywords.
+     * @param keywords List of keywords in any order.
+     * @return Amount of keywords that were removed.
+     */
+    int removeKeywords(const QStringList& keywords);
+
+    /**
+     * Adds a single keyword; prefer addKeywords() for many keywords.
+     * @param keyword Keyword to add.
+     * @return False if the keyword already exists.
+     */
+    bool addKeyword(const QString& keyword);
+
+    /**
+     * Removes a single keyword; prefer removeKeywords() for many keywords.
+     * @param keyword Keyword to remove.
+     * @return False if the keyword does not exist.
+     */
+    bool removeKeyword(const QString& keyword);
+
+    /**
+     * Determines whether a keyword exists, in constant time.
+     * @param keyword Keyword to look for; case-sensitive.
+     * @return True if the keyword exists.
+     */
+    bool contains(const QString& keyword) const;
+
+    /**
+     * Retrieves how the keywords are matched against the prefix.
+     * @return The current match mode.
+     */
+    MatchMode matchMode() const;
+
+    /**
+     * Specifies how the keywords are matched against the prefix.
+     * @param mode The match mode to use.
+     */
+    void setMatchMode(MatchMode mode);
+
+    /**
+     * Retrieves the maximum amount of fuzzy matches.
+     * @return The maximum amount of results.
+     */
+    int maxResults() const;
+
+    /**
+     * @brief Specifies the maximum amount of fuzzy matches.
+     * The rows and completions() in PrefixMatch mode are not limited.
+     * @param count The maximum amount of results.
+     */
+    void setMaxResults(int count);
+
+    /**
+     * Retrieves the prefix the rows start with.
+     * @return The current prefix.
+     */
+    const QString& prefix() const;
+
+    /**
+     * @brief Restricts the rows to the keywords starting with a prefix.
+     * The comparison is case-insensitive. An empty prefix shows all keywords.
+     * @param prefix The new prefix.
+     */
+    void setPrefix(const QString& prefix);
+
+    /**
+     * @brief Finds the completions of a word without changing the rows.
+     * Matches like the rows would for the word as prefix; all keywords
+     * starting with the prefix in PrefixMatch mode, at most maxResults()
+     * keywords in FuzzyMatch mode.
+     * @param prefix Word to complete.
+     * @return The matching keywords, best first.
+     */
+    QStringList completions(const QString& prefix) const;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
+
+private:
+    struct Entry {
+        int offset;
+        int length;
+    };
+
+    void rebuild(const QVector<QStringRef>& keywords);
+    void updateRange();
+    void findRange(const QString& prefix, int* first, int* last) const;
+    int lowerBound(const QStringRef& keyword) const;
+    QVector<int> findMatches(const QString& prefix) const;
+
+    QString _pool;
+    QVector<Entry> _entries;
+    QVector<quint64> _masks;
+    QSet<QStringRef> _lookup;
+    QString _prefix;
+    MatchMode _mode;
+    int _maxResults;
+    int _unused;
+    int _first;
+    int _last;
+    QVector<int> _matches;
+};
+
+#endif
@@ -0,0 +1,114 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#ifndef QCODEEDITOR_QCODEEDITORCOMPLETIONPROVIDER_H
+#define QCODEEDITOR_QCODEEDITORCOMPLETIONPROVIDER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <QCodeEditor/Config.hpp>
+
+class QCodeEditorCompletionModel;
+
+/**
+ * Describes the word to complete.
+ * @class QCodeEditorCompletionRequest
+ */
+struct QCodeEditorCompletionRequest
+{
+    quint64 id;     ///< Identifier of the request; never 0.
+    QString prefix; ///< Word under the cursor.
+    int position;   ///< Position of the cursor within the document.
+};
+
+/**
+ * Supplies completions for the word under the cursor.
+ * @class QCodeEditorCompletionProvider
+ *
+ * request() must return quickly; the completions are delivered later with
+ * deliver(), possibly in several parts and from any thread. Once the word
+ * changes, the request is cancelled and later deliveries are ignored, so
+ * providers only need to implement cancel() to stop expensive work.
+ */
+class QCODEEDITOR_API QCodeEditorCompletionProvider : public QObject
+{
+public:
+    QCodeEditorCompletionProvider(QObject* parent = nullptr);
+    virtual ~QCodeEditorCompletionProvider() = default;
+
+    /**
+     * Starts finding the completions of a word.
+     * @param request Word to complete and identifier to deliver with.
+     */
+    virtual void request(const QCodeEditorCompletionRequest& request) = 0;
+
+    /**
+     * @brief Stops finding the completions of a request.
+     * Does nothing by default.
+     * @param id Identifier of the request.
+     */
+    virtual void cancel(quint64 id);
+
+signals:
+
+    /**
+     * @brief Will fire if completions were found.
+     * Emitted by deliver(); the completions are best first.
+     * @param id Identifier of the request.
+     * @param completions Completions found since the previous delivery.
+     * @param finished True if the request is complete.
+     */
+    void onCompletions(quint64 id, const QStringList& completions, bool finished);
+
+protected:
+
+    /**
+     * Delivers completions of a request; thread-safe.
+     * @param id Identifier of the request.
+     * @param completions Completions found since the previous delivery.
+     * @param finished True if no more completions follow.
+     */
+    void deliver(quint64 id, const QStringList& completions, bool finished = true);
+
+private:
+    Q_OBJECT
+};
+
+
+/**
+ * Completes words from the keywords of an editor.
+ * @class QCodeEditorKeywordProvider
+ *
+ * Answers right away, using the prefix or fuzzy matching of the model.
+ */
+class QCODEEDITOR_API QCodeEditorKeywordProvider : public QCodeEditorCompletionProvider
+{
+public:
+    QCodeEditorKeywordProvider(const QCodeEditorCompletionModel* keywords, QObject* parent = nullptr);
+
+    void request(const QCodeEditorCompletionRequest& request) Q_DECL_OVERRIDE;
+
+private:
+    const QCodeEditorCompletionModel* _keywords;
+};
+
+#endif
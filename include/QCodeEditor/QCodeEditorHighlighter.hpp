@@ -20,17 +20,46 @@
 #ifndef QCODEEDITOR_QCODEEDITORHIGHLIGHTER_H
 #define QCODEEDITOR_QCODEEDITORHIGHLIGHTER_H
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QAtomicInteger>
+#include <QCache>
+#include <QMap>
+#include <QSharedPointer>
 #include <QSyntaxHighlighter>
 #include <QTextBlockUserData>
+#include <QVarLengthArray>
 #include <QObject>
-#include <QUuid>
+#include <QRect>
+#include <QVector>
 
 #include <QCodeEditor/Config.hpp>
+#include <QCodeEditor/QCompiledSyntaxRule.hpp>
 #include <QCodeEditor/QSyntaxRule.hpp>
+#include <QCodeEditor/QSyntaxTokenizer.hpp>
 #include <QCodeEditor/QCodeEditorDesign.hpp>
 
+class QTimer;
+
 class QCodeEditor;
 class QCodeEditorBlockData;
+class QCodeEditorHighlightJob;
+
+/**
+ * Describes a match that was added to or removed from a line.
+ * @class QCodeEditorMatchDelta
+ */
+struct QCodeEditorMatchDelta
+{
+    int rule;   ///< Index of the rule within QCodeEditor::rules().
+    int block;  ///< Number of the block at the time it was highlighted.
+    int start;  ///< Position within the block; -1 for removed matches.
+    int length; ///< Length of the match; 0 for removed matches.
+    quint64 id; ///< Identifier of the match.
+};
+
+Q_DECLARE_METATYPE(QCodeEditorMatchDelta)
+Q_DECLARE_METATYPE(QSyntaxBlockResult::Limit)
 
 /**
  * Highlights keywords, functions and more.
@@ -41,8 +70,42 @@ class QCodeEditorBlockData;
 class QCODEEDITOR_API QCodeEditorHighlighter : public QSyntaxHighlighter
 {
 public:
+    /**
+     * Determines how the document is highlighted.
+     */
+    enum HighlightMode {
+        SynchronousMode, ///< Highlights all blocks on the GUI thread.
+        BackgroundMode,  ///< Tokenizes on a worker thread, visible blocks first.
+        LazyMode,        ///< Only highlights the visible blocks and a margin.
+        TimeSlicedMode,  ///< Highlights in time slices on the GUI thread.
+        ParallelMode     ///< Tokenizes all blocks on several threads at once.
+    };
+
+    /**
+     * Describes the last rehighlight in ParallelMode. Dividing the work
+     * time by the wall time yields the speedup over tokenizing all blocks
+     * on a single thread.
+     */
+    struct ParallelStatistics {
+        int ranges;      ///< Amount of ranges tokenized in parallel.
+        int fixedRanges; ///< Ranges tokenized again due to an open multi-line rule.
+        qint64 workTime; ///< Time all ranges took together, in nanoseconds.
+        qint64 wallTime; ///< Time until all ranges were fixed up, in nanoseconds.
+    };
+
+    /**
+     * Describes the time spent highlighting blocks while profiling is enabled.
+     * The time of each block is stored in its QCodeEditorBlockData.
+     */
+    struct BlockProfile {
+        quint64 blocks;   ///< Amount of highlighted blocks.
+        qint64 time;      ///< Time all blocks took together, in nanoseconds.
+        qint64 maxTime;   ///< Time of the slowest block, in nanoseconds.
+        int slowestBlock; ///< Number of the slowest block or -1.
+    };
+
     QCodeEditorHighlighter(QCodeEditor* parent);
-    ~QCodeEditorHighlighter() = default;
+    ~QCodeEditorHighlighter();
 
     /**
      * @brief Updates the text char formats.
@@ -50,6 +113,296 @@ public:
      */
     void updateFormats();
 
+    /**
+     * @brief Marks the compiled rules as outdated.
+     * The rules are compiled again on the next call to updateFormats().
+     * Only needs to be called if the rules of the editor were changed.
+     */
+    void invalidateRules();
+
+    /**
+     * @brief Applies changed editor rules with as little work as possible.
+     * Rules are compared by their index. If only fonts or colors changed,
+     * the stored spans of the affected lines are formatted again without
+     * running any regex. Otherwise, only the lines the old or the new
+     * versions of the changed rules may match in are highlighted again.
+     * Falls back to requestRehighlight() if the amount of rules changed or
+     * a changed rule may match anywhere.
+     * @param previous Rules before the change.
+     */
+    void reloadRules(const QList<QSyntaxRule>& previous);
+
+    /**
+     * @brief Formats all highlighted lines with the current formats.
+     * Uses the spans stored in the block data; no regex runs and the
+     * matches of the lines are kept. Call after updateFormats().
+     */
+    void reapplyFormats();
+
+    /**
+     * @brief Updates the formats after the design of the editor changed.
+     * Rules without an own font or text color take them from the design.
+     * Only the lines containing spans of such rules are formatted again,
+     * from their stored spans, so a theme switch does not run any regex.
+     */
+    void applyDesign();
+
+    /**
+     * Retrieves the compiled rules, in the same order as the editor rules.
+     * @return List of compiled rules.
+     */
+    const QVector<QCompiledSyntaxRule>& compiledRules() const;
+
+    /**
+     * @brief Retrieves the tokenizer applying the compiled rules.
+     * Provides the prefilter counters of the rules, which are only counted
+     * while profiling and reset by resetProfile().
+     * @return The current tokenizer.
+     */
+    const QSyntaxTokenizer& tokenizer() const;
+
+    /**
+     * Determines whether single-line regex rules are merged into one regex.
+     * @return True if each block is scanned once for the merged rules.
+     */
+    bool combinedMatching() const;
+
+    /**
+     * @brief Specifies whether single-line regex rules are merged into one regex.
+     * Each block is scanned once for all global regex rules instead of once
+     * per rule, which pays off with many rules. The document is highlighted
+     * again if the setting changes; the highlighting stays the same. Disabled
+     * by default. See QSyntaxTokenizer for details.
+     * @param enabled True to merge the rules.
+     */
+    void setCombinedMatching(bool enabled);
+
+    /**
+     * Retrieves the maximum memory of the cached block results.
+     * @return The capacity of the cache in bytes.
+     */
+    int cacheSize() const;
+
+    /**
+     * @brief Specifies the maximum memory of the cached block results.
+     * Blocks whose text and entering state were tokenized before with the
+     * same rules are restored from the cache without running any regex.
+     * Each result costs about the size of its text and spans; lines longer
+     * than 1000 characters or truncated by the column limit are not cached.
+     * The least recently used results are dropped first, including those of
+     * previous rules. 0 disables the cache. Defaults to 4 MiB.
+     * @param bytes The capacity of the cache in bytes.
+     */
+    void setCacheSize(int bytes);
+
+    /**
+     * Retrieves how often a block result was restored from the cache.
+     * @return Amount of cache hits.
+     */
+    quint64 cacheHits() const;
+
+    /**
+     * Retrieves how often a block had to be tokenized.
+     * @return Amount of cache misses.
+     */
+    quint64 cacheMisses() const;
+
+    /**
+     * Resets the cache hit and miss counters to zero.
+     */
+    void resetCacheCounters();
+
+    /**
+     * Retrieves the way the document is highlighted.
+     * @return The current highlighting mode.
+     */
+    HighlightMode highlightMode() const;
+
+    /**
+     * @brief Specifies the way the document is highlighted.
+     * In BackgroundMode, the blocks are tokenized on a worker thread using a
+     * snapshot of the text and the results are applied in small batches, the
+     * visible blocks first. Edits cancel the results of the running job.
+     * Small edits are still highlighted immediately.
+     *
+     * In LazyMode, only the visible blocks and a margin around them are
+     * highlighted; all other blocks are highlighted once they are scrolled
+     * into view. Rehighlighting the document only marks the blocks, it does
+     * not run the highlighter for each of them. The state entering such a block is computed from the nearest
+     * block with a known state or from a checkpoint stored during a previous
+     * computation.
+     *
+     * In TimeSlicedMode, the document is highlighted on the GUI thread, but
+     * each event loop iteration only spends a limited amount of time on it.
+     * Blocks that exceed the budget keep their formatting and are highlighted
+     * by one of the next slices; onProgress() and onFinished() report the
+     * progress.
+     *
+     * In ParallelMode, rehighlighting the entire document splits it into
+     * ranges which are tokenized on the global thread pool. Ranges that turn
+     * out to start within a multi-line rule are tokenized again afterwards.
+     * Edits are highlighted like in SynchronousMode.
+     * @param mode Highlighting mode to use.
+     */
+    void setHighlightMode(HighlightMode mode);
+
+    /**
+     * Retrieves the amount of blocks highlighted around the visible blocks.
+     * @return The margin in blocks.
+     */
+    int lazyMargin() const;
+
+    /**
+     * @brief Specifies the amount of blocks highlighted around the visible blocks.
+     * Only used in LazyMode. A larger margin makes it less likely to see plain
+     * text while scrolling, but highlights more blocks up front.
+     * @param blocks The margin in blocks.
+     */
+    void setLazyMargin(int blocks);
+
+    /**
+     * Retrieves the time spent highlighting per event loop iteration.
+     * @return The budget in milliseconds.
+     */
+    int sliceBudget() const;
+
+    /**
+     * @brief Specifies the time spent highlighting per event loop iteration.
+     * Only used in TimeSlicedMode. The budget is checked after each block,
+     * so a single slice may take slightly longer.
+     * @param ms The budget in milliseconds.
+     */
+    void setSliceBudget(int ms);
+
+    /**
+     * Retrieves the maximum column highlighted per line.
+     * @return The column or 0 if whole lines are highlighted.
+     */
+    int maxColumn() const;
+
+    /**
+     * @brief Specifies the maximum column highlighted per line.
+     * The text after it stays plain, which protects the editor from lines
+     * such as minified code. Applies to blocks highlighted afterwards.
+     * @param column The column or 0 to highlight whole lines.
+     */
+    void setMaxColumn(int column);
+
+    /**
+     * Retrieves the time the rules may take per line.
+     * @return The budget in milliseconds or 0 if there is none.
+     */
+    int blockBudget() const;
+
+    /**
+     * @brief Specifies the time the rules may take per line.
+     * The budget is checked after each match; lines exceeding it fall back
+     * to plain text. Applies to blocks highlighted afterwards; cached results
+     * computed with another budget are not reused.
+     * @param ms The budget in milliseconds or 0 for none.
+     */
+    void setBlockBudget(int ms);
+
+    /**
+     * Retrieves the maximum amount of steps a single regex match may take.
+     * @return The limit or 0 if PCRE's default applies.
+     */
+    int matchLimit() const;
+
+    /**
+     * @brief Specifies the maximum amount of steps a single regex match may take.
+     * Guards against catastrophic backtracking. A match exceeding the limit
+     * fails, as if the rule did not match. Compiles the rules again.
+     * @param steps The limit or 0 to use PCRE's default.
+     */
+    void setMatchLimit(int steps);
+
+    /**
+     * Retrieves the time spent highlighting the document per event loop iteration.
+     * @return The budget in milliseconds or 0 if there is none.
+     */
+    int documentBudget() const;
+
+    /**
+     * @brief Specifies the time spent highlighting the document per event loop iteration.
+     * Used in SynchronousMode, LazyMode and for edits in ParallelMode. Once
+     * the budget is exceeded, the remaining blocks fall back to plain text and
+     * are highlighted in the next event loop iterations, each with its own
+     * budget. In LazyMode, only the pending blocks in view are revisited.
+     * @param ms The budget in milliseconds or 0 for none.
+     */
+    void setDocumentBudget(int ms);
+
+    /**
+     * Determines whether the cost of rules and blocks is recorded.
+     * @return True if profiling is enabled.
+     */
+    bool profiling() const;
+
+    /**
+     * @brief Specifies whether the cost of rules and blocks is recorded.
+     * Disabled by default, in which case highlighting only pays for a
+     * check per rule and block. The profiles are shared with the worker
+     * threads and start over whenever the rules are compiled again.
+     * @param enabled True to record the profiles.
+     */
+    void setProfiling(bool enabled);
+
+    /**
+     * @brief Retrieves the cost of a rule.
+     * Matches restored from the cache are not counted.
+     * @param rule Index of the rule within QCodeEditor::rules().
+     * @return Invocations, matches, bytes scanned and time of the rule.
+     */
+    QSyntaxRuleProfile ruleProfile(int rule) const;
+
+    /**
+     * Retrieves the time spent highlighting blocks on the GUI thread.
+     * @return Amount of blocks and time taken.
+     */
+    const BlockProfile& blockProfile() const;
+
+    /**
+     * Resets the profiles and prefilter counters of all rules and the
+     * profile of the blocks to zero.
+     */
+    void resetProfile();
+
+    /**
+     * @brief Describes the recorded profiles in human-readable form.
+     * Lists the rules ordered by the time they took, the merged scan and
+     * the block statistics.
+     * @return The report as plain text.
+     */
+    QString profileReport() const;
+
+    /**
+     * Writes the report of profileReport() to a file.
+     * @param path Path of the file to write.
+     * @return True if the file was written.
+     */
+    bool saveProfileReport(const QString& path) const;
+
+    /**
+     * Retrieves statistics about the last rehighlight in ParallelMode.
+     * @return Amount of ranges and time taken.
+     */
+    const ParallelStatistics& parallelStatistics() const;
+
+    /**
+     * @brief Determines whether the highlighter is formatting blocks.
+     * The document reports the formatted blocks through contentsChange()
+     * while this is the case, even though their text did not change.
+     * @return True if a block is being formatted.
+     */
+    bool isFormatting() const;
+
+    /**
+     * @brief Highlights the entire document again.
+     * Unlike rehighlight(), this respects the highlighting mode.
+     */
+    void requestRehighlight();
+
     /**
      * Applies some visual styling to text in the current line.
      * @param start Start index to apply styling to.
@@ -63,7 +416,9 @@ signals:
     /**
      * @brief Will fire if a match is found.
      * The signal will only fire if the rule containing the match has a valid
-     * and unique string identifier (e.g <rule id="foo">)
+     * and unique string identifier (e.g <rule id="foo">). The match is the
+     * last entry of the block's QCodeEditorBlockData at this point.
+     * Prefer onMatchesChanged() when highlighting large documents.
      * @param rule Rule that emitted this signal.
      * @param sequence Matched sequence.
      * @param block Current QTextBlock.
@@ -79,37 +434,220 @@ signals:
 
     /**
      * @brief Will fire if a line's highlighting was removed.
-     * @param data Data containing the UUID.
+     * All matches of the line are removed at once, before the line is
+     * highlighted again. Do not keep the pointer; it might be deleted.
+     * @param data Data containing the removed matches.
      */
     void onRemove(QCodeEditorBlockData* data);
 
+    /**
+     * @brief Will fire once per event loop iteration if matches changed.
+     * Collects the deltas of onMatch() and onRemove() of an entire
+     * rehighlight or time slice, so that listeners are notified once.
+     * Matches are only collected while this signal is connected.
+     * @param removed Matches that were removed, in the order of removal.
+     * @param added Matches that were found, in the order they were found.
+     */
+    void onMatchesChanged(const QVector<QCodeEditorMatchDelta>& removed,
+                          const QVector<QCodeEditorMatchDelta>& added);
+
+    /**
+     * @brief Will fire if a rule could not be compiled.
+     * Invalid rules are ignored while highlighting.
+     * @param rule Rule containing the invalid regex.
+     * @param message Describes the error and its position.
+     */
+    void onRuleError(const QSyntaxRule& rule, QString message);
+
+    /**
+     * @brief Will fire after each slice that did not finish highlighting.
+     * Only emitted in TimeSlicedMode.
+     * @param block Next block to highlight.
+     * @param blockCount Block at which highlighting finishes.
+     */
+    void onProgress(int block, int blockCount);
+
+    /**
+     * @brief Will fire once all pending blocks were highlighted.
+     * Only emitted in TimeSlicedMode.
+     */
+    void onFinished();
+
+    /**
+     * @brief Will fire if a line was not highlighted completely.
+     * The limit is also stored in the line's QCodeEditorBlockData. The
+     * document budget is only reported for the first line it affects.
+     * @param block Line that was limited.
+     * @param rule Index of the rule that exceeded the block budget or -1.
+     * @param limit Limit that was exceeded.
+     */
+    void onLimitExceeded(QTextBlock block, int rule, QSyntaxBlockResult::Limit limit);
+
 protected:
     void highlightBlock(const QString &text) Q_DECL_OVERRIDE;
 
+private slots:
+    void startJob();
+    void applyResults();
+    void resetSyncBudget();
+    void highlightViewport();
+    void viewportUpdated(const QRect& rect, int dy);
+    void highlightSlice();
+    void flushMatches();
+    void documentChanged(int position, int charsRemoved, int charsAdded);
+
 private:
+    void compileRules();
+    void reformatBlocks(const QVector<bool>& rules);
+    QVector<bool> changedFormats(const QList<QTextCharFormat>& formats,
+                                 const QVector<QList<QTextCharFormat>>& groupFormats) const;
+    void rehighlightRules(const QVector<bool>& rules);
+    void dropSpans(const QVector<bool>& rules);
+    void formatBlock(const QTextBlock& block);
+    void formatDocument();
+    void createTokenizer(const QVector<QCompiledSyntaxRule>& rules);
+    void updateGeneration();
+    void highlightText(const QString& text);
+    void recordBlock(qint64 time);
+    void cancelJob();
+    void deferBlock();
+    void visibleBlocks(int* first, int* last) const;
+    int resolveState(const QTextBlock& block);
+    void dropCheckpoints(int block);
+    void scheduleSlice(int first, int end);
+    bool exceedsDocumentBudget();
+    void rehighlightParallel();
+    void rehighlightLazily();
+    void highlightLimited();
+    QSyntaxBlockResult tokenize(const QString& text, int state);
+    void applyResult(const QString& text, const QSyntaxBlockResult& result);
+    void applyFormats(const QVector<QSyntaxSpan>& spans);
+    QTextCharFormat createFormat(bool useFont, const QFont& font,
+                                 const QColor& foreColor, const QColor& backColor) const;
+    QTextCharFormat createGroupFormat(const QTextCharFormat& ruleFormat, const QSyntaxGroup& group) const;
+    quint64 nextBlockId();
+
     const QList<QSyntaxRule>* _rules;
     const QCodeEditorDesign* _design;
     const QCodeEditor* _parent;
     QList<QTextCharFormat> _formats;
+    QVector<QList<QTextCharFormat>> _groupFormats;
+    QSyntaxTokenizer _tokenizer;
+    bool _rulesChanged;
+    bool _combine;
+
+    HighlightMode _mode;
+    QSharedPointer<QCodeEditorHighlightJob> _job;
+    QVector<QSyntaxBlockResult> _applyQueue;
+    QVector<int> _applyBlocks;
+    int _applyIndex;
+    const QSyntaxBlockResult* _precomputed;
+    int _precomputedBlock;
+    int _precomputedCount;
+    int _syncBlocks;
+    bool _applying;
+    QTimer* _applyTimer;
+    QTimer* _restartTimer;
+    QTimer* _budgetTimer;
+
+    int _lazyMargin;
+    QMap<int, int> _checkpoints;
+    QTimer* _viewportTimer;
+    int _viewportFirst;
+    int _viewportLast;
+
+    int _sliceBudget;
+    int _sliceCursor;
+    int _sliceEnd;
+    int _blockCount;
+    QElapsedTimer _sliceClock;
+    QTimer* _sliceTimer;
+
+    ParallelStatistics _parallelStats;
+    int _maxColumn;
+    int _blockBudget;
+    int _matchLimit;
+    int _documentBudget;
+    bool _documentLimited;
+    int _limitedBlock;
+    bool _profiling;
+    bool _reformatting;
+    bool _formatting;
+    BlockProfile _blockProfile;
+
+    struct CacheKey {
+        QString text;
+        int state;
+        int generation;
+
+        bool operator==(const CacheKey& key) const
+        {
+            return state == key.state && generation == key.generation && text == key.text;
+        }
+
+        friend uint qHash(const CacheKey& key, uint seed = 0)
+        {
+            return qHash(key.text, seed) ^ uint(key.state) ^ (uint(key.generation) << 16);
+        }
+    };
+
+    QCache<CacheKey, QSyntaxBlockResult> _cache;
+    QString _generationKey;
+    QString _signature;
+    int _generation;
+    quint64 _cacheHits;
+    quint64 _cacheMisses;
+
+    QAtomicInteger<quint64> _nextBlockId;
+    QVector<QCodeEditorMatchDelta> _removedMatches;
+    QVector<QCodeEditorMatchDelta> _addedMatches;
+    QTimer* _flushTimer;
 
     Q_OBJECT
 };
 
 
 /**
- * Holds an unique identifier.
+ * Holds the spans and matches of a line, each match with an unique identifier.
  * @author Nicolas Kogler
  * @date October 29th, 2016
  * @class QCodeEditorBlockData
+ *
+ * The identifiers are taken from a counter of the highlighter that created
+ * the data. They are unique among all block data of one editor and never
+ * reused during its lifetime; 0 is never assigned. The spans allow to
+ * format the line again without running any regex. Lines without spans
+ * and limits do not have any block data, unless profiling is enabled.
  */
 class QCODEEDITOR_API QCodeEditorBlockData : public QTextBlockUserData
 {
 public:
-    QCodeEditorBlockData(QString r);
-    ~QCodeEditorBlockData();
+    struct Match {
+        int rule;   ///< Index of the rule within QCodeEditor::rules().
+        quint64 id; ///< Identifier of the match.
+    };
+
+    QCodeEditorBlockData() = default;
+    ~QCodeEditorBlockData() = default;
+
+    /**
+     * Finds the match with the given identifier.
+     * @param id Identifier of the match.
+     * @return The match or nullptr if the line does not contain it.
+     */
+    const Match* find(quint64 id) const;
+
+    // most lines contain a single match, which is stored inline
+    QVarLengthArray<Match, 1> matches;
+
+    // spans of the last highlighting, shared with the tokenizer's result
+    QVector<QSyntaxSpan> spans;
+
+    // limit that kept the line from being highlighted completely
+    QSyntaxBlockResult::Limit limit = QSyntaxBlockResult::NoLimit;
 
-    QUuid id;
-    QString re;
+    // time the line took to highlight while profiling, in nanoseconds
+    qint64 highlightTime = 0;
 };
 
 
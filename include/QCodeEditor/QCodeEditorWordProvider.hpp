@@ -0,0 +1,154 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#ifndef QCODEEDITOR_QCODEEDITORWORDPROVIDER_H
+#define QCODEEDITOR_QCODEEDITORWORDPROVIDER_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include <QCodeEditor/Config.hpp>
+#include <QCodeEditor/QCodeEditorChangeTracker.hpp>
+#include <QCodeEditor/QCodeEditorCompletionProvider.hpp>
+
+class QTextDocument;
+
+/**
+ * Completes words from the identifiers within a document.
+ * @class QCodeEditorWordProvider
+ *
+ * Every distinct identifier is stored once, together with the amount of
+ * its occurrences. Each block only remembers the identifiers it contains,
+ * so that the changes reported by a QCodeEditorChangeTracker are applied
+ * by rescanning the changed blocks; the document is never copied. The
+ * identifiers are additionally kept in case-insensitive order, so that the
+ * words starting with a prefix are found by binary search. Words that occur
+ * more often are suggested first.
+ */
+class QCODEEDITOR_API QCodeEditorWordProvider : public QCodeEditorCompletionProvider
+{
+public:
+    /**
+     * Indexes the given document and follows its changes.
+     * @param document Document to index.
+     * @param tracker Tracker of the document.
+     * @param parent Parent of the provider.
+     */
+    QCodeEditorWordProvider(QTextDocument* document, QCodeEditorChangeTracker* tracker,
+                            QObject* parent = nullptr);
+
+    /**
+     * Retrieves the minimum length of an indexed identifier.
+     * @return The amount of characters.
+     */
+    int minimumLength() const;
+
+    /**
+     * @brief Specifies the minimum length of an indexed identifier.
+     * Reindexes the whole document. Defaults to 3.
+     * @param length The amount of characters.
+     */
+    void setMinimumLength(int length);
+
+    /**
+     * Retrieves the maximum amount of completions per request.
+     * @return The amount of completions.
+     */
+    int maxResults() const;
+
+    /**
+     * @brief Specifies the maximum amount of completions per request.
+     * Defaults to 50.
+     * @param count The amount of completions.
+     */
+    void setMaxResults(int count);
+
+    /**
+     * Retrieves the amount of distinct identifiers.
+     * @return The amount of words in the index.
+     */
+    int wordCount() const;
+
+    /**
+     * Retrieves how often an identifier occurs in the document.
+     * @param word Identifier to look up.
+     * @return The amount of occurrences; 0 if it does not occur.
+     */
+    int references(const QString& word) const;
+
+    /**
+     * Retrieves how long the last update of the index took.
+     * @return The time in nanoseconds.
+     */
+    qint64 updateTime() const;
+
+    /**
+     * @brief Estimates the memory used by the index.
+     * Counts the words, the hash table, the sorted index and the identifiers
+     * of the blocks, but not the allocator overhead.
+     * @return The size in bytes.
+     */
+    qint64 memoryUsage() const;
+
+    /**
+     * @brief Indexes the whole document again.
+     * Normally one would not need this, because the changes of the
+     * document are applied automatically.
+     */
+    void rebuild();
+
+    void request(const QCodeEditorCompletionRequest& request) Q_DECL_OVERRIDE;
+
+private slots:
+    void update(const QVector<QCodeEditorChange>& changes, quint64 revision);
+
+private:
+    struct Word
+    {
+        QString text;   ///< The identifier; empty if the slot is free.
+        int references; ///< Amount of occurrences.
+    };
+
+    void addBlock(int block, const QString& text);
+    void removeBlock(int block);
+    int acquire(const QChar* text, int length);
+    void release(int id);
+    int lowerBound(const QString& word) const;
+    void findRange(const QString& prefix, int* first, int* last) const;
+
+    QTextDocument* _document;
+    QCodeEditorChangeTracker* _tracker;
+    QHash<QString, int> _ids;
+    QVector<Word> _words;
+    QVector<int> _freeIds;
+    QVector<int> _sorted;
+    QVector<QVector<int>> _blocks;
+    quint64 _revision;
+    qint64 _updateTime;
+    int _minimumLength;
+    int _maxResults;
+    bool _rebuilding;
+
+    Q_OBJECT
+};
+
+
+#endif
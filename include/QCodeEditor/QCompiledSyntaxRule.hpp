@@ -0,0 +1,206 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef QCODEEDITOR_QCOMPILEDSYNTAXRULE_H
+#define QCODEEDITOR_QCOMPILEDSYNTAXRULE_H
+
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QStringMatcher>
+#include <QVector>
+
+#include <QCodeEditor/Config.hpp>
+#include <QCodeEditor/QSyntaxKeywordMatcher.hpp>
+#include <QCodeEditor/QSyntaxRule.hpp>
+
+/**
+ * @class QCompiledSyntaxRule
+ * @brief Holds the compiled regular expressions of a QSyntaxRule.
+ *
+ * The expressions are compiled and optimized once on construction, so that
+ * the highlighter does not need to compile them again for every block.
+ * Keyword rules are compiled into a QSyntaxKeywordMatcher instead, unless a
+ * keyword contains regex syntax such as "operator\+"; such rules are
+ * compiled from the equivalent regex of the rule, as they used to be.
+ *
+ * For regex rules, the literals every match must contain are derived from
+ * the pattern (e.g. "def" for ^\s*def\b). Blocks that contain none of them
+ * are skipped without running the regex.
+ */
+class QCODEEDITOR_API QCompiledSyntaxRule
+{
+public:
+    QCompiledSyntaxRule();
+    QCompiledSyntaxRule(const QSyntaxRule& rule, int matchLimit = 0);
+    QCompiledSyntaxRule(const QCompiledSyntaxRule& rule) = default;
+    QCompiledSyntaxRule& operator=(const QCompiledSyntaxRule& rule) = default;
+    ~QCompiledSyntaxRule() = default;
+
+    /**
+     * Retrieves the compiled opening regex of a multiline rule.
+     * @return The compiled opening regex. Never matches for keyword rules.
+     */
+    const QRegularExpression& openingRegex() const;
+
+    /**
+     * Retrieves the main pattern as specified by the rule.
+     * @return The pattern without the match limit.
+     */
+    const QString& pattern() const;
+
+    /**
+     * @brief Retrieves the maximum amount of steps of a single match.
+     * Matches exceeding the limit fail, as if there was no match.
+     * @return The match limit or 0 if PCRE's default applies.
+     */
+    int matchLimit() const;
+
+    /**
+     * Retrieves the compiled main regex.
+     * @return The compiled regex. Never matches for keyword rules.
+     */
+    const QRegularExpression& regex() const;
+
+    /**
+     * Retrieves the keyword matcher.
+     * @return The keyword matcher. Is empty for regex rules.
+     */
+    const QSyntaxKeywordMatcher& keywordMatcher() const;
+
+    /**
+     * Determines whether the rule matches keywords instead of a regex.
+     * @return True if the keyword matcher is used.
+     */
+    bool hasKeywords() const;
+
+    /**
+     * Finds the next match of the main regex or the keywords.
+     * @param text Text to search in.
+     * @param offset Position to start searching at.
+     * @param length Receives the length of the match.
+     * @return Position of the match or -1 if there is none.
+     */
+    int indexIn(const QString& text, int offset, int* length) const;
+
+    /**
+     * Finds the next match and keeps the match for its capture groups.
+     * @param text Text to search in.
+     * @param offset Position to start searching at.
+     * @param length Receives the length of the match.
+     * @param match Receives the regex match; untouched for keyword rules.
+     * @return Position of the match or -1 if there is none.
+     */
+    int indexIn(const QString& text, int offset, int* length, QRegularExpressionMatch* match) const;
+
+    /**
+     * Determines whether capture groups have their own appearance.
+     * @return True if groupCaptures() is not empty.
+     */
+    bool hasGroups() const;
+
+    /**
+     * Retrieves the capture numbers of the rule's groups.
+     * @return Capture number for each QSyntaxGroup of the rule, in order.
+     */
+    const QVector<int>& groupCaptures() const;
+
+    /**
+     * Determines whether a literal was derived from the main regex.
+     * @return True if mayMatch() can rule out blocks.
+     */
+    bool hasPrefilter() const;
+
+    /**
+     * Retrieves the literals derived from the main regex.
+     * @return List of literals; every match contains at least one of them.
+     */
+    const QStringList& requiredLiterals() const;
+
+    /**
+     * @brief Determines whether the main regex could match the text.
+     * Only searches for the required literals, which is a lot cheaper than
+     * running the regex. Always true if there is no prefilter.
+     * @param text Text to check.
+     * @return False if the main regex can not match the text.
+     */
+    bool mayMatch(const QString& text) const;
+
+    /**
+     * Retrieves the compiled closing regex of a multiline rule.
+     * @return The compiled closing regex.
+     */
+    const QRegularExpression& closingRegex() const;
+
+    /**
+     * Determines whether the regex search is global.
+     * @return True if all matches in a line are highlighted.
+     */
+    bool isGlobal() const;
+
+    /**
+     * Determines whether the rule reports its matches.
+     * @return True if the rule has a string identifier.
+     */
+    bool hasId() const;
+
+    /**
+     * Determines whether the rule spans multiple lines.
+     * @return True if the rule has a closing regex.
+     */
+    bool isMultiLine() const;
+
+    /**
+     * Determines whether the rule is the only rule of a line it matches.
+     * @return True if the rule is exclusive.
+     */
+    bool isExclusive() const;
+
+    /**
+     * Determines whether all expressions of the rule compiled.
+     * @return True if the rule can be used for highlighting.
+     */
+    bool isValid() const;
+
+    /**
+     * Retrieves the compile error of the first invalid expression.
+     * @return The error message or an empty string.
+     */
+    const QString& errorString() const;
+
+private:
+    QRegularExpression _startReg;
+    QRegularExpression _regex;
+    QRegularExpression _endReg;
+    QString _pattern;
+    int _matchLimit;
+    QSyntaxKeywordMatcher _keywords;
+    QStringList _literals;
+    QVector<QStringMatcher> _literalMatchers;
+    QVector<int> _groupCaptures;
+    QString _error;
+    bool _isGlobal;
+    bool _hasId;
+    bool _isMultiLine;
+    bool _isExclusive;
+    bool _hasKeywords;
+};
+
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef QCODEEDITOR_QSYNTAXKEYWORDMATCHER_H
+#define QCODEEDITOR_QSYNTAXKEYWORDMATCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <QCodeEditor/Config.hpp>
+
+/**
+ * @class QSyntaxKeywordMatcher
+ * @brief Finds keywords in a line by walking a character trie.
+ *
+ * Only positions at which a word begins are tried and each try walks at most
+ * as many characters as the longest keyword has, therefore the cost of a
+ * search depends on the length of the line rather than the amount of keywords.
+ * A keyword must not be directly preceded or followed by a word character
+ * (letter, digit or underscore) if it begins or ends with one. Overlapping
+ * keywords are resolved in favor of the longest one.
+ */
+class QCODEEDITOR_API QSyntaxKeywordMatcher
+{
+public:
+    QSyntaxKeywordMatcher();
+    QSyntaxKeywordMatcher(const QStringList& keywords, bool lineBegin, Qt::CaseSensitivity cs);
+    QSyntaxKeywordMatcher(const QSyntaxKeywordMatcher& matcher) = default;
+    QSyntaxKeywordMatcher& operator=(const QSyntaxKeywordMatcher& matcher) = default;
+    ~QSyntaxKeywordMatcher() = default;
+
+    /**
+     * Determines whether the matcher contains no keywords.
+     * @return True if there are no keywords.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Finds the next keyword in the given text.
+     * @param text Text to search in.
+     * @param offset Position to start searching at.
+     * @param length Receives the length of the found keyword.
+     * @return Position of the keyword or -1 if there is none.
+     */
+    int indexIn(const QString& text, int offset, int* length) const;
+
+private:
+    int matchAt(const QString& text, int pos) const;
+    QChar fold(QChar c) const;
+
+    struct Node {
+        int edges;
+        int edgeCount;
+        bool terminal;
+    };
+
+    struct Edge {
+        ushort ch;
+        int node;
+    };
+
+    QVector<Node> _nodes;
+    QVector<Edge> _edges;
+    bool _lineBegin;
+    bool _caseInsensitive;
+};
+
+
+#endif
@@ -20,11 +20,104 @@
 #define QCODEEDITOR_QSYNTAXRULE_H
 
 #include <QColor>
+#include <QList>
 #include <QString>
+#include <QStringList>
 
 #include <QCodeEditor/Config.hpp>
 #include <QCodeEditor/QCodeEditorDesign.hpp>
 
+/**
+ * @class QSyntaxGroup
+ * @brief Specifies the appearance of a capture group within a rule's match.
+ *
+ * The group is either referred to by its name (e.g. (?<module>...)) or by
+ * its index. Its format is applied on top of the format of the whole match.
+ */
+class QCODEEDITOR_API QSyntaxGroup
+{
+public:
+    QSyntaxGroup();
+    QSyntaxGroup(const QSyntaxGroup& group) = default;
+    QSyntaxGroup& operator=(const QSyntaxGroup& group) = default;
+    ~QSyntaxGroup() = default;
+
+    /**
+     * Retrieves the name of the capture group.
+     * @return The name or an empty string if the index is used.
+     */
+    const QString& name() const;
+
+    /**
+     * Retrieves the index of the capture group.
+     * @return The index; only used if there is no name.
+     */
+    int index() const;
+
+    /**
+     * Retrieves the font of the captured text.
+     * @return The font in which the captured text is rendered.
+     */
+    const QFont& font() const;
+
+    /**
+     * Retrieves the background color of the captured text.
+     * @return The background color.
+     */
+    const QColor& backColor() const;
+
+    /**
+     * Retrieves the foreground color of the captured text.
+     * @return The foreground color.
+     */
+    const QColor& foreColor() const;
+
+    /**
+     * Determines whether a custom font is used.
+     * @return True if a custom font is used.
+     */
+    bool useFont() const;
+
+    /**
+     * Specifies the capture group by its name.
+     * @param name Name of the capture group.
+     */
+    void setName(const QString& name);
+
+    /**
+     * Specifies the capture group by its index.
+     * @param index Index of the capture group, starting at 1.
+     */
+    void setIndex(int index);
+
+    /**
+     * Specifies the font in which the captured text is rendered.
+     * @param font Font to use.
+     */
+    void setFont(const QFont& font);
+
+    /**
+     * Specifies the background color of the captured text.
+     * @param backColor Background color to use.
+     */
+    void setBackColor(const QColor& backColor);
+
+    /**
+     * Specifies the foreground color of the captured text.
+     * @param foreColor Foreground color to use.
+     */
+    void setForeColor(const QColor& foreColor);
+
+private:
+    QString _name;
+    int _index;
+    QFont _font;
+    QColor _backColor;
+    QColor _foreColor;
+    bool _useFont;
+};
+
+
 /**
  * @author Nicolas Kogler
  * @date October 4th, 2016
@@ -33,8 +126,8 @@
  *
  * Under the hood, each regular expression is forwarded to a function that
  * searches for matches in the code editor's text. If there are matches, they
- * are colored and transformed as specified. Keywords will be directly converted
- * to a regular expression.
+ * are colored and transformed as specified. Keywords are matched by a dedicated
+ * keyword matcher; the equivalent regular expression is still provided by regex().
  *
  * TODO: Keywords, regex and opening/closing regex should be abstracted. (QAbstractSyntaxRule)
  */
@@ -88,18 +181,48 @@ public:
      */
     const QString& closingRegex() const;
 
+    /**
+     * Retrieves the keywords of this rule.
+     * @return The keywords or an empty list if the rule uses a regex.
+     */
+    const QStringList& keywords() const;
+
+    /**
+     * Determines whether keywords are only matched at the beginning of a line.
+     * @return True if only the first word in a line is matched.
+     */
+    bool keywordsAtLineBegin() const;
+
+    /**
+     * Retrieves the case sensitivity of the keywords.
+     * @return Qt::CaseInsensitive if the keywords ignore the case.
+     */
+    Qt::CaseSensitivity keywordCaseSensitivity() const;
+
     /**
      * Determines whether the regex search should be global.
      * @return True to search globally.
      */
     bool isGlobal() const;
 
+    /**
+     * Determines whether the rule is the only rule of a line it matches.
+     * @return True if the rule is exclusive.
+     */
+    bool isExclusive() const;
+
     /**
      * Determines whether a custom font is used.
      * @return True if a custom font is used.
      */
     bool useFont() const;
 
+    /**
+     * Retrieves the capture groups with their own appearance.
+     * @return List of capture groups.
+     */
+    const QList<QSyntaxGroup>& groups() const;
+
     /**
      * Specifies the regular expression for this rule.
      * @param regex Escaped regex sequence.
@@ -108,12 +231,18 @@ public:
 
     /**
      * @brief Specifies the keywords.
-     * The keywords will be automatically translated into a regular expression.
+     * The keywords will be matched literally by a keyword matcher instead of
+     * a regex. If any keyword contains regex syntax (a backslash or one of
+     * ^$.|?*+()[]{}), all keywords of the rule are matched as the regex
+     * alternation instead, which keeps older rule files working, but is a
+     * lot slower.
      * A usage example for 'lineBegin=true' could be preprocessor directives.
      * @param keywords List of keyword strings.
      * @param lineBegin Should keywords be at the beginning of a line?
+     * @param cs Whether the keywords are case sensitive.
      */
-    void setKeywords(const QStringList& keywords, bool lineBegin = false);
+    void setKeywords(const QStringList& keywords, bool lineBegin = false,
+                     Qt::CaseSensitivity cs = Qt::CaseSensitive);
 
     /**
      * Specifies the font in which matches are rendered.
@@ -157,6 +286,30 @@ public:
      */
     void setGlobal(bool global);
 
+    /**
+     * @brief Specifies whether the rule is the only rule of a line it matches.
+     * Exclusive rules are tried before all other rules, in their order. Once
+     * one of them matches, no other rule is evaluated for the line, which
+     * suits preprocessor directives or line comments. On lines continuing a
+     * multi-line rule, exclusive rules are applied like ordinary rules.
+     * @param exclusive True to make the rule exclusive.
+     */
+    void setExclusive(bool exclusive);
+
+    /**
+     * @brief Adds a capture group with its own appearance.
+     * All groups are highlighted from the same match as the rule itself.
+     * Not supported for keyword rules.
+     * @param group Capture group to add.
+     */
+    void addGroup(const QSyntaxGroup& group);
+
+    /**
+     * Specifies the capture groups with their own appearance.
+     * @param groups List of capture groups.
+     */
+    void setGroups(const QList<QSyntaxGroup>& groups);
+
 private:
     QString _regex;
     QFont _font;
@@ -165,7 +318,12 @@ private:
     QString _id;
     QString _startReg;
     QString _endReg;
+    QStringList _keywords;
+    QList<QSyntaxGroup> _groups;
+    Qt::CaseSensitivity _keywordCase;
+    bool _keywordsAtLineBegin;
     bool _isGlobal;
+    bool _isExclusive;
     bool _useFont;
 
 };
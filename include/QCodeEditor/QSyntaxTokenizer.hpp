@@ -0,0 +1,221 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#ifndef QCODEEDITOR_QSYNTAXTOKENIZER_H
+#define QCODEEDITOR_QSYNTAXTOKENIZER_H
+
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include <QCodeEditor/Config.hpp>
+#include <QCodeEditor/QCompiledSyntaxRule.hpp>
+
+struct QSyntaxTokenizerCounters;
+
+/**
+ * Describes a highlighted range within a block.
+ * @class QSyntaxSpan
+ */
+struct QSyntaxSpan
+{
+    int rule;   ///< Index of the rule that produced the span.
+    int start;  ///< Position of the span within the block.
+    int length; ///< Length of the span.
+    int group;  ///< 0 for the whole match, else the index of the QSyntaxGroup + 1.
+};
+
+/**
+ * Holds the outcome of tokenizing a single block.
+ * @class QSyntaxBlockResult
+ */
+struct QSyntaxBlockResult
+{
+    /**
+     * Describes which guard limited the highlighting of a block.
+     */
+    enum Limit {
+        NoLimit,          ///< The block was highlighted completely.
+        ColumnLimit,      ///< Only the columns up to the maximum were highlighted.
+        BlockTimeLimit,   ///< A rule exceeded the time budget of the block.
+        DocumentTimeLimit ///< The time budget of the document was exceeded.
+    };
+
+    QSyntaxBlockResult() : state(-1), limit(NoLimit), limitRule(-1) {}
+
+    QVector<QSyntaxSpan> spans;   ///< Spans to format, in application order.
+    QVector<QSyntaxSpan> matches; ///< Matches of rules that have an id.
+    int state;                    ///< Open multi-line rule or -1.
+    Limit limit;                  ///< Guard that limited the highlighting.
+    int limitRule;                ///< Rule that exceeded the time budget or -1.
+};
+
+/**
+ * Holds the cumulative cost of a rule while profiling is enabled.
+ * @class QSyntaxRuleProfile
+ */
+struct QSyntaxRuleProfile
+{
+    quint64 invocations;  ///< Amount of blocks the rule was matched against.
+    quint64 matches;      ///< Amount of matches found.
+    quint64 bytesScanned; ///< Size of the matched blocks in UTF-16 bytes.
+    qint64 time;          ///< Time spent matching, in nanoseconds.
+};
+
+/**
+ * @class QSyntaxTokenizer
+ * @brief Applies compiled syntax rules to the text of a block.
+ *
+ * The tokenizer does not touch the document, therefore a copy of it
+ * can be used from any thread.
+ *
+ * By default, every rule scans the text on its own. Optionally, all global
+ * single-line regex rules are merged into one alternation, so that a block
+ * is only scanned once for all of them. Every merged rule still continues
+ * where its own scan would, and the other rules are checked at the start
+ * of each match, so the spans are the same as with separate scans. Rules
+ * using back references, named groups, subroutine calls, recursion or
+ * conditions are not merged.
+ *
+ * Exclusive rules are tried first, in their order. The first one that
+ * matches is the only rule applied to the line; all others are skipped.
+ * Lines continuing a multi-line rule apply them like ordinary rules.
+ *
+ * Optionally, only the first columns of long lines are tokenized, and a
+ * block falls back to plain text if its rules exceed a time budget. Single
+ * runaway matches are bounded by the match limit of the compiled rules.
+ *
+ * Rules that are scanned on their own are skipped for blocks that do not
+ * contain any of their required literals. While profiling is enabled, the
+ * amount of skipped blocks is counted per rule and shared by all copies of
+ * a tokenizer, just like the profiles.
+ */
+class QCODEEDITOR_API QSyntaxTokenizer
+{
+public:
+    QSyntaxTokenizer() = default;
+    QSyntaxTokenizer(const QVector<QCompiledSyntaxRule>& rules, bool combine = false);
+    QSyntaxTokenizer(const QSyntaxTokenizer& tokenizer) = default;
+    QSyntaxTokenizer& operator=(const QSyntaxTokenizer& tokenizer) = default;
+    ~QSyntaxTokenizer() = default;
+
+    /**
+     * Retrieves the compiled rules.
+     * @return List of compiled rules.
+     */
+    const QVector<QCompiledSyntaxRule>& rules() const;
+
+    /**
+     * Determines whether rules were merged into a single regex.
+     * @return True if blocks are scanned once for the merged rules.
+     */
+    bool isCombined() const;
+
+    /**
+     * @brief Specifies the guards applied to every block.
+     * Lines longer than the maximum column are only tokenized up to it.
+     * Blocks whose rules take longer than the budget are not highlighted;
+     * the budget is checked after each match.
+     * @param maxColumn Maximum column to tokenize; 0 for no limit.
+     * @param blockBudget Time budget per block in milliseconds; 0 for none.
+     */
+    void setLimits(int maxColumn, int blockBudget);
+
+    /**
+     * Retrieves how often the prefilter of a rule was checked while profiling.
+     * @param rule Index of the rule.
+     * @return Amount of blocks checked against the required literals.
+     */
+    quint64 filteredCount(int rule) const;
+
+    /**
+     * Retrieves how often a rule was skipped by its prefilter while profiling.
+     * @param rule Index of the rule.
+     * @return Amount of blocks the regex did not need to run for.
+     */
+    quint64 skippedCount(int rule) const;
+
+    /**
+     * Resets the prefilter counters and profiles of all rules to zero.
+     */
+    void resetCounters();
+
+    /**
+     * Determines whether the cost of each rule is recorded.
+     * @return True if profiling is enabled.
+     */
+    bool isProfiling() const;
+
+    /**
+     * @brief Specifies whether the cost of each rule is recorded.
+     * Disabled by default, which leaves a single check per rule.
+     * @param enabled True to record the profiles.
+     */
+    void setProfiling(bool enabled);
+
+    /**
+     * @brief Retrieves the cost of a rule.
+     * Merged rules only count their matches; the time and bytes of the
+     * merged scan are part of combinedProfile() instead.
+     * @param rule Index of the rule.
+     * @return The profile recorded since the last reset.
+     */
+    QSyntaxRuleProfile profile(int rule) const;
+
+    /**
+     * Retrieves the cost of the scan for all merged rules.
+     * @return The profile recorded since the last reset.
+     */
+    QSyntaxRuleProfile combinedProfile() const;
+
+    /**
+     * Tokenizes the text of one block.
+     * @param text Text of the block.
+     * @param previousState State of the previous block.
+     * @return The spans, matches and state of the block.
+     */
+    QSyntaxBlockResult tokenize(const QString& text, int previousState) const;
+
+private:
+    void combineRules();
+    QSyntaxBlockResult tokenizeText(const QString& text, int previousState) const;
+    bool tokenizeRule(int ruleIndex, const QString& text, QSyntaxBlockResult& result,
+                      const QElapsedTimer* clock) const;
+    bool matchRule(int ruleIndex, const QString& text, QSyntaxBlockResult& result,
+                   const QElapsedTimer* clock) const;
+    void record(int slot, qint64 time, int matches, int length) const;
+    void tokenizeCombined(const QString& text, QSyntaxBlockResult& result,
+                          const QElapsedTimer* clock) const;
+
+    QVector<QCompiledSyntaxRule> _rules;
+    QRegularExpression _combined;
+    QVector<int> _combinedRules;
+    QVector<int> _combinedGroups;
+    QVector<bool> _isCombined;
+    QVector<int> _exclusiveRules;
+    int _maxColumn = 0;
+    int _blockBudget = 0;
+    bool _profiling = false;
+    QSharedPointer<QSyntaxTokenizerCounters> _counters;
+};
+
+
+#endif
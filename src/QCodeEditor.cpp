@@ -24,6 +24,11 @@
 #include <QStandardItemModel>
 
 #include <QCodeEditor/QCodeEditor.hpp>
+#include <QCodeEditor/QCodeEditorChangeTracker.hpp>
+#include <QCodeEditor/QCodeEditorCompleter.hpp>
+#include <QCodeEditor/QCodeEditorCompletionModel.hpp>
+#include <QCodeEditor/QCodeEditorCompletionProvider.hpp>
+#include <QCodeEditor/QCodeEditorWordProvider.hpp>
 #include <QCodeEditor/QCodeEditorPopup.hpp>
 #include <QCodeEditor/QCodeEditorLineWidget.hpp>
 #include <QCodeEditor/QCodeEditorHighlighter.hpp>
@@ -34,11 +39,20 @@ QCodeEditor::QCodeEditor(QWidget* parent)
     : QPlainTextEdit(parent)
     , _popup(new QCodeEditorPopup(this))
     , _highlighter(new QCodeEditorHighlighter(this))
-    , _sourceModel(new QStandardItemModel())
+    , _completionModel(new QCodeEditorCompletionModel(this))
+    , _completer(new QCodeEditorCompleter(this))
+    , _keywordProvider(new QCodeEditorKeywordProvider(_completionModel, this))
+    , _keywordModel(nullptr)
     , _ruleFilter(new QSortFilterProxyModel(this))
     , _autoComplete(new QCompleter(this))
     , _completionTrigger(3)
     , _textFinder(QCodeEditorTextFinder::makeDialog(this))
+    , _changeTracker(new QCodeEditorChangeTracker(document(), this))
+    , _wordProvider(new QCodeEditorWordProvider(document(), _changeTracker, this))
+    , _configDepth(0)
+    , _designPending(false)
+    , _rulesPending(false)
+    , _keywordsPending(false)
 {
     QFont monospace("Monospace");
     monospace.setPointSize(10);
@@ -48,8 +62,12 @@ QCodeEditor::QCodeEditor(QWidget* parent)
 
     _autoComplete->setWidget(this);
     _autoComplete->setCompletionMode(QCompleter::PopupCompletion);
-    _autoComplete->setModelSorting(QCompleter::CaseInsensitivelySortedModel);
+    _autoComplete->setModelSorting(QCompleter::UnsortedModel);
     _autoComplete->setPopup(_popup);
+    _autoComplete->setModel(_completer);
+    _completer->addProvider(_keywordProvider);
+    _completer->addProvider(_wordProvider);
+    _changeTracker->setHighlighter(_highlighter);
     _ruleFilter->setFilterCaseSensitivity(Qt::CaseInsensitive);
     _ruleFilter->setDynamicSortFilter(false);
     _lineWidget = new QCodeEditorLineWidget(this);
@@ -63,6 +81,8 @@ QCodeEditor::QCodeEditor(QWidget* parent)
     connect(this, SIGNAL(updateRequest(QRect,int)), this, SLOT(scrollLineColumn(QRect,int)));
     connect(this, SIGNAL(blockCountChanged(int)), this, SLOT(updateLineColumn(int)));
     connect(this, SIGNAL(textChanged()), this, SLOT(textChanged()));
+    connect(_completer, SIGNAL(rowsAboutToBeInserted(QModelIndex,int,int)), this, SLOT(saveCompletion()));
+    connect(_completer, SIGNAL(onUpdated(int,bool)), this, SLOT(showCompletions()));
 }
 
 const QList<QSyntaxRule> &QCodeEditor::rules() const
@@ -90,25 +110,86 @@ QCodeEditorHighlighter *QCodeEditor::highlighter() const
     return _highlighter;
 }
 
+QCodeEditorChangeTracker *QCodeEditor::changeTracker() const
+{
+    return _changeTracker;
+}
+
 void QCodeEditor::setRules(const QList<QSyntaxRule>& rules)
 {
+    if (_configDepth > 0) {
+        // the highlighter keeps using the current rules until the commit
+        _pendingRules = rules;
+        _rulesPending = true;
+        return;
+    }
+
+    const QList<QSyntaxRule> previous = _rules;
     _rules = rules;
-    _highlighter->updateFormats();
-    _highlighter->rehighlight();
+    _highlighter->reloadRules(previous);
 }
 
 void QCodeEditor::setDesign(const QCodeEditorDesign& design)
 {
     _design = design;
-    setFont(design.editorFont());
+    if (_configDepth > 0) {
+        _designPending = true;
+        return;
+    }
+
+    updateDesign();
+    _highlighter->applyDesign();
+}
+
+void QCodeEditor::beginConfiguration()
+{
+    ++_configDepth;
+}
+
+void QCodeEditor::commitConfiguration()
+{
+    if (_configDepth == 0 || --_configDepth > 0) {
+        return;
+    }
+
+    if (_designPending) {
+        updateDesign();
+    }
+
+    // comparing the formats also covers the ones changed by the design
+    if (_rulesPending) {
+        const QList<QSyntaxRule> previous = _rules;
+        _rules = _pendingRules;
+        _pendingRules.clear();
+        _highlighter->reloadRules(previous);
+    } else if (_designPending) {
+        _highlighter->applyDesign();
+    }
+
+    if (_keywordsPending) {
+        updateKeywordModel();
+    }
+
+    _designPending = false;
+    _rulesPending = false;
+    _keywordsPending = false;
+}
+
+bool QCodeEditor::isConfiguring() const
+{
+    return _configDepth > 0;
+}
+
+void QCodeEditor::updateDesign()
+{
+    setFont(_design.editorFont());
 
     QPalette palette;
-    palette.setColor(QPalette::Base, design.editorBackColor());
-    palette.setColor(QPalette::Text, design.editorTextColor());
+    palette.setColor(QPalette::Base, _design.editorBackColor());
+    palette.setColor(QPalette::Text, _design.editorTextColor());
     setPalette(palette);
 
-    setStyleSheet(QCodeEditorStyleSheets::border(design));
-    _highlighter->updateFormats();
+    setStyleSheet(QCodeEditorStyleSheets::border(_design));
 }
 
 void QCodeEditor::setCompletionTrigger(qint32 amount)
@@ -118,52 +199,78 @@ void QCodeEditor::setCompletionTrigger(qint32 amount)
 
 void QCodeEditor::setKeywords(const QStringList& keywords)
 {
-    qint32 size = keywords.size();
+    // sorting is deferred to the commit of a configuration
+    _pendingKeywords += keywords;
 
-    for (int i = 0; i < size; i++) {
-        auto item = new QStandardItem;
-        item->setText(keywords.at(i));
-        _sourceModel->appendRow(item);
+    if (_configDepth > 0) {
+        _keywordsPending = true;
+    } else {
+        updateKeywordModel();
     }
+}
 
-    _ruleFilter->setSourceModel(_sourceModel);
-    _ruleFilter->sort(0);
-    _autoComplete->setModel(_ruleFilter);
+void QCodeEditor::updateKeywordModel()
+{
+    // keywords are added to the existing ones and sorted once
+    _completionModel->addKeywords(_pendingKeywords);
+    _pendingKeywords.clear();
 }
 
 void QCodeEditor::setKeywordModel(QStandardItemModel* model)
 {
-    _ruleFilter->setSourceModel(model);
-    _autoComplete->setModel(_ruleFilter);
+    _keywordModel = model;
+    if (model != nullptr) {
+        _ruleFilter->setSourceModel(model);
+        _autoComplete->setModel(_ruleFilter);
+    } else {
+        _autoComplete->setModel(_completer);
+    }
+}
+
+QCodeEditorCompletionModel* QCodeEditor::completionModel() const
+{
+    return _completionModel;
+}
+
+QCodeEditorCompleter* QCodeEditor::completer() const
+{
+    return _completer;
+}
+
+QCodeEditorWordProvider* QCodeEditor::wordProvider() const
+{
+    return _wordProvider;
 }
 
 void QCodeEditor::addKeyword(const QString& keyword)
 {
-    if (!keywordExists(keyword)) {
-        auto item = new QStandardItem;
-        item->setText(keyword);
-        _sourceModel->appendRow(item);
-        _ruleFilter->sort(0);
-    }
+    _completionModel->addKeyword(keyword);
+}
+
+void QCodeEditor::addKeywords(const QStringList& keywords)
+{
+    _completionModel->addKeywords(keywords);
 }
 
 void QCodeEditor::removeKeyword(const QString& keyword)
 {
-    auto keywords = _sourceModel->findItems(keyword);
-    if (keywords.size() == 1) {
-        _sourceModel->removeRow(keywords.at(0)->row());
-    }
+    _completionModel->removeKeyword(keyword);
+}
+
+void QCodeEditor::removeKeywords(const QStringList& keywords)
+{
+    _completionModel->removeKeywords(keywords);
 }
 
 bool QCodeEditor::keywordExists(const QString &keyword)
 {
-    return !_sourceModel->findItems(keyword).isEmpty();
+    return _completionModel->contains(keyword);
 }
 
 
 void QCodeEditor::rehighlight()
 {
-    _highlighter->rehighlight();
+    _highlighter->requestRehighlight();
 }
 
 int QCodeEditor::lineColumnWidth() const
@@ -324,6 +431,7 @@ void QCodeEditor::keyPressEvent(QKeyEvent* event)
     if (event->key() == Qt::Key_Backspace) {
         if (cursor.selectedText().trimmed().isEmpty()) {
             _autoComplete->popup()->hide();
+            _completer->cancel();
             return;
         }
     }
@@ -344,23 +452,59 @@ void QCodeEditor::keyPressEvent(QKeyEvent* event)
 
         // hides the completion menu
         _autoComplete->popup()->hide();
+        _completer->cancel();
         return;
     }
 
-    QString prefix = QString("^") + cursor.selectedText();
-    _ruleFilter->setFilterRegExp(QRegExp(prefix, Qt::CaseInsensitive));
-    _autoComplete->popup()->setCurrentIndex(_autoComplete->completionModel()->index(0, 0));
+    QString prefix = cursor.selectedText();
+    if (_keywordModel != nullptr) {
+        // custom models can only be filtered row by row
+        _ruleFilter->setFilterRegExp(QRegExp("^" + QRegExp::escape(prefix), Qt::CaseInsensitive));
+        showCompletions();
+    } else {
+        // the popup is shown once the providers answer
+        _completer->complete(prefix, textCursor().position());
+    }
+}
 
-    if (_autoComplete->popup()->model()->rowCount() == 0) {
-        _autoComplete->popup()->hide();
+void QCodeEditor::saveCompletion()
+{
+    const QModelIndex current = _autoComplete->popup()->currentIndex();
+    if (_autoComplete->popup()->isVisible() && current.isValid() && _currentCompletion.isEmpty()) {
+        _currentCompletion = current.data().toString();
+    }
+}
+
+void QCodeEditor::showCompletions()
+{
+    QAbstractItemView* popup = _autoComplete->popup();
+    if (popup->model()->rowCount() == 0) {
+        popup->hide();
         return;
     }
 
-    if (!_autoComplete->popup()->isVisible()) {
+    // the completer's own model resets whenever rows are inserted, which
+    // loses the selection; it is restored while further completions arrive.
+    QAbstractItemModel* model = _autoComplete->completionModel();
+    QModelIndex current = model->index(0, 0);
+    if (popup->isVisible() && !_currentCompletion.isEmpty()) {
+        const QModelIndexList found = model->match(current, Qt::DisplayRole, _currentCompletion, 1,
+                                                   Qt::MatchExactly | Qt::MatchCaseSensitive);
+        if (!found.isEmpty()) {
+            current = found.first();
+        }
+    }
+
+    _currentCompletion.clear();
+    popup->setCurrentIndex(current);
+
+    if (!popup->isVisible()) {
+        QTextCursor cursor = textCursor();
+        cursor.select(QTextCursor::WordUnderCursor);
+
         QRect rect = cursorRect();
-        rect.moveTo(rect.x() + lineColumnWidth() - fontMetrics().width(prefix), rect.y()+4);
-        rect.setWidth(_autoComplete->popup()->sizeHintForColumn(0) +
-            _autoComplete->popup()->verticalScrollBar()->sizeHint().width());
+        rect.moveTo(rect.x() + lineColumnWidth() - fontMetrics().width(cursor.selectedText()), rect.y()+4);
+        rect.setWidth(popup->sizeHintForColumn(0) + popup->verticalScrollBar()->sizeHint().width());
         _autoComplete->complete(rect);
     }
 }
@@ -0,0 +1,144 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTimer>
+
+#include <QCodeEditor/QCodeEditorChangeTracker.hpp>
+#include <QCodeEditor/QCodeEditorHighlighter.hpp>
+
+QCodeEditorChangeTracker::QCodeEditorChangeTracker(QTextDocument* document, QObject* parent)
+    : QObject(parent)
+    , _document(document)
+    , _highlighter(nullptr)
+    , _revision(0)
+    , _blockCount(document->blockCount())
+    , _timer(new QTimer(this))
+{
+    qRegisterMetaType<QCodeEditorChange>("QCodeEditorChange");
+    qRegisterMetaType<QVector<QCodeEditorChange>>("QVector<QCodeEditorChange>");
+
+    _timer->setInterval(50);
+    _timer->setSingleShot(true);
+
+    connect(_timer, SIGNAL(timeout()), this, SLOT(flush()));
+    connect(document, SIGNAL(contentsChange(int,int,int)), this, SLOT(contentsChange(int,int,int)));
+}
+
+quint64 QCodeEditorChangeTracker::revision() const
+{
+    return _revision;
+}
+
+const QCodeEditorHighlighter* QCodeEditorChangeTracker::highlighter() const
+{
+    return _highlighter;
+}
+
+void QCodeEditorChangeTracker::setHighlighter(const QCodeEditorHighlighter* highlighter)
+{
+    _highlighter = highlighter;
+}
+
+int QCodeEditorChangeTracker::interval() const
+{
+    return _timer->interval();
+}
+
+void QCodeEditorChangeTracker::setInterval(int ms)
+{
+    _timer->setInterval(qMax(0, ms));
+}
+
+const QVector<QCodeEditorChange>& QCodeEditorChangeTracker::pendingChanges() const
+{
+    return _changes;
+}
+
+void QCodeEditorChangeTracker::flush()
+{
+    _timer->stop();
+    if (_changes.isEmpty()) {
+        return;
+    }
+
+    QVector<QCodeEditorChange> changes;
+    changes.swap(_changes);
+    emit onChanged(changes, _revision);
+}
+
+void QCodeEditorChangeTracker::contentsChange(int position, int charsRemoved, int charsAdded)
+{
+    // layout updates do not change any text
+    if (charsRemoved == 0 && charsAdded == 0) {
+        return;
+    }
+
+    // the highlighter reports formatted blocks as if they were replaced
+    if (charsRemoved == charsAdded && _highlighter != nullptr && _highlighter->isFormatting()) {
+        return;
+    }
+
+    const int blockDelta = _document->blockCount() - _blockCount;
+    _blockCount = _document->blockCount();
+    ++_revision;
+
+    if (!merge(position, charsRemoved, charsAdded, blockDelta)) {
+        QCodeEditorChange change = { position, charsRemoved, charsAdded, 0, 0, blockDelta, _revision };
+        updateBlocks(change);
+        _changes.push_back(change);
+    }
+
+    // the timer is not restarted, which limits the rate of notifications
+    if (!_timer->isActive()) {
+        _timer->start();
+    }
+}
+
+bool QCodeEditorChangeTracker::merge(int position, int charsRemoved, int charsAdded, int blockDelta)
+{
+    if (_changes.isEmpty()) {
+        return false;
+    }
+
+    // the change only touches the text added by the previous change, which
+    // happens while typing or correcting what was just typed.
+    QCodeEditorChange& last = _changes.last();
+    if (position < last.position || position + charsRemoved > last.position + last.charsAdded) {
+        return false;
+    }
+
+    last.charsAdded += charsAdded - charsRemoved;
+    last.blockDelta += blockDelta;
+    last.revision = _revision;
+    updateBlocks(last);
+    return true;
+}
+
+void QCodeEditorChangeTracker::updateBlocks(QCodeEditorChange& change) const
+{
+    change.firstBlock = _document->findBlock(change.position).blockNumber();
+    change.lastBlock = _document->findBlock(change.position + change.charsAdded).blockNumber();
+
+    // the position after the last character does not belong to any block
+    if (change.lastBlock == -1) {
+        change.lastBlock = _document->blockCount() - 1;
+    }
+}
@@ -0,0 +1,230 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QTimer>
+
+#include <QCodeEditor/QCodeEditorCompleter.hpp>
+#include <QCodeEditor/QCodeEditorCompletionProvider.hpp>
+
+QCodeEditorCompleter::QCodeEditorCompleter(QObject* parent)
+    : QAbstractListModel(parent)
+    , _position(0)
+    , _id(0)
+    , _nextId(0)
+    , _stale(false)
+    , _debounceTimer(new QTimer(this))
+{
+    qRegisterMetaType<quint64>("quint64");
+
+    _debounceTimer->setInterval(0);
+    _debounceTimer->setSingleShot(true);
+
+    connect(_debounceTimer, SIGNAL(timeout()), this, SLOT(startRequest()));
+}
+
+void QCodeEditorCompleter::addProvider(QCodeEditorCompletionProvider* provider)
+{
+    if (provider == nullptr || _providers.contains(provider)) {
+        return;
+    }
+
+    abort();
+    _providers.push_back(provider);
+    _counts.push_back(0);
+
+    // providers might deliver from other threads
+    connect(provider, SIGNAL(onCompletions(quint64,QStringList,bool)),
+            this, SLOT(receive(quint64,QStringList,bool)));
+    connect(provider, SIGNAL(destroyed(QObject*)), this, SLOT(providerDestroyed(QObject*)));
+}
+
+void QCodeEditorCompleter::removeProvider(QCodeEditorCompletionProvider* provider)
+{
+    const int index = _providers.indexOf(provider);
+    if (index == -1) {
+        return;
+    }
+
+    cancel();
+    disconnect(provider, nullptr, this, nullptr);
+    _providers.removeAt(index);
+    _counts.remove(index);
+}
+
+const QList<QCodeEditorCompletionProvider*>& QCodeEditorCompleter::providers() const
+{
+    return _providers;
+}
+
+int QCodeEditorCompleter::debounce() const
+{
+    return _debounceTimer->interval();
+}
+
+void QCodeEditorCompleter::setDebounce(int ms)
+{
+    _debounceTimer->setInterval(qMax(0, ms));
+}
+
+const QString& QCodeEditorCompleter::prefix() const
+{
+    return _prefix;
+}
+
+bool QCodeEditorCompleter::isRunning() const
+{
+    return _debounceTimer->isActive() || !_running.isEmpty();
+}
+
+void QCodeEditorCompleter::complete(const QString& prefix, int position)
+{
+    if (prefix == _prefix && (_id != 0 || _debounceTimer->isActive())) {
+        return;
+    }
+
+    // the rows stay until the completions of the new word arrive
+    abort();
+    _prefix = prefix;
+    _position = position;
+    _debounceTimer->start();
+}
+
+void QCodeEditorCompleter::cancel()
+{
+    abort();
+    _prefix.clear();
+    clearRows();
+}
+
+int QCodeEditorCompleter::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : _rows.size();
+}
+
+QVariant QCodeEditorCompleter::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= _rows.size()) {
+        return QVariant();
+    }
+
+    if (role == Qt::DisplayRole || role == Qt::EditRole) {
+        return _rows.at(index.row());
+    }
+
+    return QVariant();
+}
+
+void QCodeEditorCompleter::startRequest()
+{
+    _id = ++_nextId;
+    _stale = true;
+
+    QCodeEditorCompletionRequest request = { _id, _prefix, _position };
+    const QList<QCodeEditorCompletionProvider*> providers = _providers;
+    for (QCodeEditorCompletionProvider* provider : providers) {
+        _running.insert(provider);
+    }
+
+    // providers answering right away call receive() from within request()
+    for (QCodeEditorCompletionProvider* provider : providers) {
+        if (_id == request.id) {
+            provider->request(request);
+        }
+    }
+}
+
+void QCodeEditorCompleter::receive(quint64 id, const QStringList& completions, bool finished)
+{
+    auto provider = static_cast<QCodeEditorCompletionProvider*>(sender());
+    if (id != _id || !_running.contains(provider)) {
+        return;
+    }
+
+    if (_stale) {
+        clearRows();
+        _stale = false;
+    }
+
+    QStringList added;
+    for (const QString& completion : completions) {
+        if (!_listed.contains(completion)) {
+            _listed.insert(completion);
+            added.push_back(completion);
+        }
+    }
+
+    // the completions of a provider follow the ones of earlier providers
+    const int index = _providers.indexOf(provider);
+    int row = 0;
+    for (int i = 0; i <= index; ++i) {
+        row += _counts.at(i);
+    }
+
+    if (!added.isEmpty()) {
+        beginInsertRows(QModelIndex(), row, row + added.size() - 1);
+        for (int i = 0; i < added.size(); ++i) {
+            _rows.insert(row + i, added.at(i));
+        }
+
+        _counts[index] += added.size();
+        endInsertRows();
+    }
+
+    if (finished) {
+        _running.remove(provider);
+    }
+
+    emit onUpdated(_rows.size(), _running.isEmpty());
+}
+
+void QCodeEditorCompleter::providerDestroyed(QObject* provider)
+{
+    // the object is not a provider anymore, only its address is compared
+    auto destroyed = static_cast<QCodeEditorCompletionProvider*>(provider);
+    const int index = _providers.indexOf(destroyed);
+    if (index != -1) {
+        _running.remove(destroyed);
+        cancel();
+        _providers.removeAt(index);
+        _counts.remove(index);
+    }
+}
+
+void QCodeEditorCompleter::abort()
+{
+    _debounceTimer->stop();
+    if (_id != 0) {
+        for (QCodeEditorCompletionProvider* provider : _running) {
+            provider->cancel(_id);
+        }
+    }
+
+    _running.clear();
+    _id = 0;
+}
+
+void QCodeEditorCompleter::clearRows()
+{
+    beginResetModel();
+    _rows.clear();
+    _listed.clear();
+    _counts.fill(0);
+    _stale = false;
+    endResetModel();
+}
@@ -0,0 +1,485 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QCodeEditor/QCodeEditorCompletionModel.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+// orders case-insensitively, equal keywords of different case by their case
+static bool lessKeyword(const QStringRef& a, const QStringRef& b)
+{
+    const int order = QStringRef::compare(a, b, Qt::CaseInsensitive);
+    return order < 0 || (order == 0 && a < b);
+}
+
+static int comparePrefix(const QStringRef& keyword, const QString& prefix)
+{
+    return QStringRef::compare(keyword.left(prefix.size()), prefix, Qt::CaseInsensitive);
+}
+
+// one bit per letter, digit and underscore; other characters share the rest
+static quint64 characterMask(const QStringRef& text)
+{
+    quint64 mask = 0;
+    for (const QChar& c : text) {
+        const ushort u = c.toLower().unicode();
+        if (u >= 'a' && u <= 'z') {
+            mask |= Q_UINT64_C(1) << (u - 'a');
+        } else if (u >= '0' && u <= '9') {
+            mask |= Q_UINT64_C(1) << (26 + u - '0');
+        } else if (u == '_') {
+            mask |= Q_UINT64_C(1) << 36;
+        } else {
+            mask |= Q_UINT64_C(1) << (37 + u % 27);
+        }
+    }
+
+    return mask;
+}
+
+// scores the pattern as subsequence of the keyword; -1 if it is none
+static int fuzzyScore(const QStringRef& keyword, const QString& pattern, const QString& lowerPattern)
+{
+    int score = 0;
+    int previous = -2;
+    int k = 0;
+
+    for (int i = 0; i < keyword.size() && k < pattern.size(); ++i) {
+        const QChar c = keyword.at(i);
+        if (c.toLower() != lowerPattern.at(k)) {
+            continue;
+        }
+
+        int bonus = 1;
+        if (i == 0) {
+            bonus += 8;
+        } else if (!keyword.at(i - 1).isLetterOrNumber()) {
+            bonus += 6;
+        } else if (c.isUpper() && keyword.at(i - 1).isLower()) {
+            bonus += 6;
+        }
+
+        if (previous == i - 1) {
+            bonus += 4;
+        }
+
+        if (c == pattern.at(k)) {
+            bonus += 1;
+        }
+
+        score += bonus;
+        previous = i;
+        ++k;
+    }
+
+    if (k < pattern.size()) {
+        return -1;
+    }
+
+    // shorter keywords win among equal matches
+    return score * 64 - qMin(63, keyword.size());
+}
+
+struct Candidate
+{
+    int score;
+    int index;
+};
+
+static bool betterCandidate(const Candidate& a, const Candidate& b)
+{
+    return a.score > b.score || (a.score == b.score && a.index < b.index);
+}
+
+QCodeEditorCompletionModel::QCodeEditorCompletionModel(QObject* parent)
+    : QAbstractListModel(parent)
+    , _mode(PrefixMatch)
+    , _maxResults(50)
+    , _unused(0)
+    , _first(0)
+    , _last(0)
+{
+}
+
+int QCodeEditorCompletionModel::keywordCount() const
+{
+    return _entries.size();
+}
+
+QStringRef QCodeEditorCompletionModel::keywordAt(int index) const
+{
+    const Entry& entry = _entries.at(index);
+    return QStringRef(&_pool, entry.offset, entry.length);
+}
+
+QStringList QCodeEditorCompletionModel::keywords() const
+{
+    QStringList keywords;
+    keywords.reserve(_entries.size());
+    for (int i = 0; i < _entries.size(); ++i) {
+        keywords.push_back(keywordAt(i).toString());
+    }
+
+    return keywords;
+}
+
+void QCodeEditorCompletionModel::setKeywords(const QStringList& keywords)
+{
+    rebuild(QVector<QStringRef>());
+    addKeywords(keywords);
+}
+
+int QCodeEditorCompletionModel::addKeywords(const QStringList& keywords)
+{
+    QVector<QStringRef> added;
+    for (const QString& keyword : keywords) {
+        if (!keyword.isEmpty() && !contains(keyword)) {
+            added.push_back(QStringRef(&keyword));
+        }
+    }
+
+    if (added.isEmpty()) {
+        return 0;
+    }
+
+    // sorts the batch once and merges it into the sorted keywords
+    std::sort(added.begin(), added.end(), lessKeyword);
+    added.erase(std::unique(added.begin(), added.end()), added.end());
+
+    QVector<QStringRef> existing;
+    existing.reserve(_entries.size());
+    for (int i = 0; i < _entries.size(); ++i) {
+        existing.push_back(keywordAt(i));
+    }
+
+    QVector<QStringRef> merged;
+    merged.reserve(existing.size() + added.size());
+    std::merge(existing.begin(), existing.end(), added.begin(), added.end(),
+               std::back_inserter(merged), lessKeyword);
+
+    rebuild(merged);
+    return added.size();
+}
+
+int QCodeEditorCompletionModel::removeKeywords(const QStringList& keywords)
+{
+    QSet<QStringRef> removed;
+    for (const QString& keyword : keywords) {
+        if (contains(keyword)) {
+            removed.insert(QStringRef(&keyword));
+        }
+    }
+
+    if (removed.isEmpty()) {
+        return 0;
+    }
+
+    QVector<QStringRef> kept;
+    kept.reserve(_entries.size() - removed.size());
+    for (int i = 0; i < _entries.size(); ++i) {
+        if (!removed.contains(keywordAt(i))) {
+            kept.push_back(keywordAt(i));
+        }
+    }
+
+    rebuild(kept);
+    return removed.size();
+}
+
+bool QCodeEditorCompletionModel::addKeyword(const QString& keyword)
+{
+    if (keyword.isEmpty() || contains(keyword)) {
+        return false;
+    }
+
+    // the keyword is appended to the pool, so that the existing references
+    // stay valid; only its entry is inserted in order.
+    const int index = lowerBound(QStringRef(&keyword));
+    Entry entry = { _pool.size(), keyword.size() };
+
+    beginResetModel();
+    _pool.append(keyword);
+    _entries.insert(index, entry);
+    _masks.insert(index, characterMask(QStringRef(&keyword)));
+    _lookup.insert(keywordAt(index));
+    updateRange();
+    endResetModel();
+    return true;
+}
+
+bool QCodeEditorCompletionModel::removeKeyword(const QString& keyword)
+{
+    if (!contains(keyword)) {
+        return false;
+    }
+
+    // the characters stay in the pool until most of it is unused
+    const int index = lowerBound(QStringRef(&keyword));
+    _unused += _entries.at(index).length;
+    _lookup.remove(keywordAt(index));
+
+    if (_unused > _pool.size() / 2) {
+        QVector<QStringRef> kept;
+        kept.reserve(_entries.size() - 1);
+        for (int i = 0; i < _entries.size(); ++i) {
+            if (i != index) {
+                kept.push_back(keywordAt(i));
+            }
+        }
+
+        rebuild(kept);
+        return true;
+    }
+
+    beginResetModel();
+    _entries.remove(index);
+    _masks.remove(index);
+    updateRange();
+    endResetModel();
+    return true;
+}
+
+bool QCodeEditorCompletionModel::contains(const QString& keyword) const
+{
+    return _lookup.contains(QStringRef(&keyword));
+}
+
+const QString& QCodeEditorCompletionModel::prefix() const
+{
+    return _prefix;
+}
+
+void QCodeEditorCompletionModel::setPrefix(const QString& prefix)
+{
+    if (_prefix == prefix) {
+        return;
+    }
+
+    beginResetModel();
+    _prefix = prefix;
+    updateRange();
+    endResetModel();
+}
+
+QCodeEditorCompletionModel::MatchMode QCodeEditorCompletionModel::matchMode() const
+{
+    return _mode;
+}
+
+void QCodeEditorCompletionModel::setMatchMode(MatchMode mode)
+{
+    if (_mode == mode) {
+        return;
+    }
+
+    beginResetModel();
+    _mode = mode;
+    updateRange();
+    endResetModel();
+}
+
+int QCodeEditorCompletionModel::maxResults() const
+{
+    return _maxResults;
+}
+
+void QCodeEditorCompletionModel::setMaxResults(int count)
+{
+    beginResetModel();
+    _maxResults = qMax(1, count);
+    updateRange();
+    endResetModel();
+}
+
+int QCodeEditorCompletionModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : _last - _first;
+}
+
+QVariant QCodeEditorCompletionModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= _last - _first) {
+        return QVariant();
+    }
+
+    if (role == Qt::DisplayRole || role == Qt::EditRole) {
+        const int row = _first + index.row();
+        return keywordAt(_matches.isEmpty() ? row : _matches.at(row)).toString();
+    }
+
+    return QVariant();
+}
+
+void QCodeEditorCompletionModel::rebuild(const QVector<QStringRef>& keywords)
+{
+    int size = 0;
+    for (const QStringRef& keyword : keywords) {
+        size += keyword.size();
+    }
+
+    // the keywords might refer to the current pool, which is replaced last
+    QString pool;
+    pool.reserve(size);
+    QVector<Entry> entries;
+    entries.reserve(keywords.size());
+    QVector<quint64> masks;
+    masks.reserve(keywords.size());
+
+    for (const QStringRef& keyword : keywords) {
+        Entry entry = { pool.size(), keyword.size() };
+        entries.push_back(entry);
+        masks.push_back(characterMask(keyword));
+        pool.append(keyword);
+    }
+
+    beginResetModel();
+    _pool = pool;
+    _entries = entries;
+    _masks = masks;
+    _unused = 0;
+
+    _lookup.clear();
+    _lookup.reserve(_entries.size());
+    for (int i = 0; i < _entries.size(); ++i) {
+        _lookup.insert(keywordAt(i));
+    }
+
+    updateRange();
+    endResetModel();
+}
+
+QStringList QCodeEditorCompletionModel::completions(const QString& prefix) const
+{
+    QStringList completions;
+    if (_mode == FuzzyMatch && !prefix.isEmpty()) {
+        for (int index : findMatches(prefix)) {
+            completions.push_back(keywordAt(index).toString());
+        }
+    } else {
+        int first, last;
+        findRange(prefix, &first, &last);
+        for (int i = first; i < last; ++i) {
+            completions.push_back(keywordAt(i).toString());
+        }
+    }
+
+    return completions;
+}
+
+void QCodeEditorCompletionModel::updateRange()
+{
+    if (_mode == FuzzyMatch && !_prefix.isEmpty()) {
+        _matches = findMatches(_prefix);
+        _first = 0;
+        _last = _matches.size();
+    } else {
+        _matches.clear();
+        findRange(_prefix, &_first, &_last);
+    }
+}
+
+void QCodeEditorCompletionModel::findRange(const QString& prefix, int* first, int* last) const
+{
+    // the keywords starting with the prefix are contiguous
+    int low = 0;
+    int high = _entries.size();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (comparePrefix(keywordAt(middle), prefix) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *first = low;
+    high = _entries.size();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (comparePrefix(keywordAt(middle), prefix) <= 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *last = low;
+}
+
+int QCodeEditorCompletionModel::lowerBound(const QStringRef& keyword) const
+{
+    int low = 0;
+    int high = _entries.size();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (lessKeyword(keywordAt(middle), keyword)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+QVector<int> QCodeEditorCompletionModel::findMatches(const QString& prefix) const
+{
+    // folds each character on its own, so that the positions stay the same
+    QString lowerPrefix = prefix;
+    for (int i = 0; i < lowerPrefix.size(); ++i) {
+        lowerPrefix[i] = lowerPrefix.at(i).toLower();
+    }
+
+    const quint64 required = characterMask(QStringRef(&prefix));
+
+    // the heap keeps the worst of the best matches on top
+    QVector<Candidate> heap;
+    heap.reserve(_maxResults + 1);
+
+    for (int i = 0; i < _entries.size(); ++i) {
+        if ((_masks.at(i) & required) != required) {
+            continue;
+        }
+
+        Candidate candidate = { fuzzyScore(keywordAt(i), prefix, lowerPrefix), i };
+        if (candidate.score < 0) {
+            continue;
+        }
+
+        if (heap.size() < _maxResults) {
+            heap.push_back(candidate);
+            std::push_heap(heap.begin(), heap.end(), betterCandidate);
+        } else if (betterCandidate(candidate, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), betterCandidate);
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end(), betterCandidate);
+        }
+    }
+
+    std::sort_heap(heap.begin(), heap.end(), betterCandidate);
+
+    QVector<int> matches;
+    matches.reserve(heap.size());
+    for (const Candidate& candidate : heap) {
+        matches.push_back(candidate.index);
+    }
+
+    return matches;
+}
@@ -0,0 +1,48 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QCodeEditor/QCodeEditorCompletionModel.hpp>
+#include <QCodeEditor/QCodeEditorCompletionProvider.hpp>
+
+QCodeEditorCompletionProvider::QCodeEditorCompletionProvider(QObject* parent)
+    : QObject(parent)
+{
+}
+
+void QCodeEditorCompletionProvider::cancel(quint64 id)
+{
+    Q_UNUSED(id);
+}
+
+void QCodeEditorCompletionProvider::deliver(quint64 id, const QStringList& completions, bool finished)
+{
+    // receivers on other threads get a queued copy
+    emit onCompletions(id, completions, finished);
+}
+
+QCodeEditorKeywordProvider::QCodeEditorKeywordProvider(const QCodeEditorCompletionModel* keywords, QObject* parent)
+    : QCodeEditorCompletionProvider(parent)
+    , _keywords(keywords)
+{
+}
+
+void QCodeEditorKeywordProvider::request(const QCodeEditorCompletionRequest& request)
+{
+    deliver(request.id, _keywords->completions(request.prefix));
+}
@@ -0,0 +1,199 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "QCodeEditorHighlightJob.hpp"
+
+// amount of blocks that are published at once
+static const int BatchSize = 256;
+
+class QCodeEditorHighlightRunnable : public QRunnable
+{
+public:
+    QCodeEditorHighlightRunnable(const QSharedPointer<QCodeEditorHighlightJob>& job)
+        : _job(job)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        _job->run();
+    }
+
+private:
+    QSharedPointer<QCodeEditorHighlightJob> _job;
+};
+
+QCodeEditorHighlightJob::QCodeEditorHighlightJob(const QSyntaxTokenizer& tokenizer, const QString& text, int blockCount)
+    : _tokenizer(tokenizer)
+    , _text(text)
+    , _blockCount(blockCount)
+    , _firstPriority(0)
+    , _lastPriority(-1)
+    , _priorityState(-1)
+    , _cancelled(0)
+    , _done(0)
+{
+}
+
+void QCodeEditorHighlightJob::setPriorityRange(int first, int last, int state)
+{
+    _firstPriority = first;
+    _lastPriority = qMin(last, _blockCount - 1);
+    _priorityState = state;
+}
+
+void QCodeEditorHighlightJob::start(const QSharedPointer<QCodeEditorHighlightJob>& job)
+{
+    // the runnable shares the job, so that it stays alive even if the
+    // highlighter drops it while the worker is still running.
+    QThreadPool::globalInstance()->start(new QCodeEditorHighlightRunnable(job));
+}
+
+void QCodeEditorHighlightJob::cancel()
+{
+    _cancelled.storeRelease(1);
+
+    QMutexLocker lock(&_mutex);
+    _results.clear();
+}
+
+bool QCodeEditorHighlightJob::isCancelled() const
+{
+    return _cancelled.loadAcquire() != 0;
+}
+
+bool QCodeEditorHighlightJob::isFinished() const
+{
+    QMutexLocker lock(&_mutex);
+    return _done.loadAcquire() != 0 && _results.isEmpty();
+}
+
+QVector<QCodeEditorHighlightJob::Item> QCodeEditorHighlightJob::takeResults()
+{
+    QVector<Item> results;
+
+    QMutexLocker lock(&_mutex);
+    results.swap(_results);
+    return results;
+}
+
+void QCodeEditorHighlightJob::run()
+{
+    tokenizeAll();
+    _done.storeRelease(1);
+}
+
+void QCodeEditorHighlightJob::tokenizeAll()
+{
+    // finds the start of every block in the snapshot
+    QVector<int> starts;
+    starts.reserve(_blockCount);
+    starts.push_back(0);
+
+    int pos = 0;
+    while (starts.size() < _blockCount) {
+        pos = _text.indexOf(QChar::ParagraphSeparator, pos);
+        if (pos == -1) {
+            break;
+        }
+
+        starts.push_back(++pos);
+    }
+
+    // tokenizes the visible blocks first
+    QVector<Item> batch;
+    QVector<int> enteringStates;
+    QVector<int> leavingStates;
+    int state = _priorityState;
+
+    for (int block = _firstPriority; block <= _lastPriority; ++block) {
+        if (isCancelled()) {
+            return;
+        }
+
+        Item item;
+        item.block = block;
+        item.result = _tokenizer.tokenize(blockText(starts, block), state);
+        enteringStates.push_back(state);
+        leavingStates.push_back(item.result.state);
+        state = item.result.state;
+        batch.push_back(item);
+    }
+
+    publish(batch);
+
+    // tokenizes the whole document, skipping all visible
+    // blocks that were entered with the correct state.
+    state = -1;
+    for (int block = 0; block < _blockCount; ++block) {
+        if (isCancelled()) {
+            return;
+        }
+
+        const int visible = block - _firstPriority;
+        if (visible >= 0 && visible < enteringStates.size() && enteringStates.at(visible) == state) {
+            state = leavingStates.at(visible);
+            continue;
+        }
+
+        Item item;
+        item.block = block;
+        item.result = _tokenizer.tokenize(blockText(starts, block), state);
+        state = item.result.state;
+        batch.push_back(item);
+
+        if (batch.size() >= BatchSize) {
+            publish(batch);
+        }
+    }
+
+    publish(batch);
+}
+
+void QCodeEditorHighlightJob::publish(QVector<Item>& batch)
+{
+    if (batch.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker lock(&_mutex);
+    if (!isCancelled()) {
+        _results += batch;
+    }
+
+    batch.clear();
+}
+
+QString QCodeEditorHighlightJob::blockText(const QVector<int>& starts, int block) const
+{
+    if (block < 0 || block >= starts.size()) {
+        return QString();
+    }
+
+    const int start = starts.at(block);
+    int end = _text.indexOf(QChar::ParagraphSeparator, start);
+    if (end == -1) {
+        end = _text.size();
+    }
+
+    return _text.mid(start, end - start);
+}
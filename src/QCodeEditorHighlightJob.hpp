@@ -0,0 +1,113 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QCODEEDITOR_QCODEEDITORHIGHLIGHTJOB_H
+#define QCODEEDITOR_QCODEEDITORHIGHLIGHTJOB_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include <QCodeEditor/QSyntaxTokenizer.hpp>
+
+/**
+ * Tokenizes a snapshot of the document on a worker thread.
+ * @class QCodeEditorHighlightJob
+ *
+ * The visible blocks are tokenized first, starting with the state the
+ * document currently stores for them. Afterwards, the whole document is
+ * tokenized from the beginning; visible blocks are only delivered again if
+ * they were entered with a different state. Results are published in
+ * batches and taken by the GUI thread.
+ */
+class QCodeEditorHighlightJob
+{
+public:
+    struct Item {
+        int block;
+        QSyntaxBlockResult result;
+    };
+
+    /**
+     * Creates a new job for the given snapshot.
+     * @param tokenizer Tokenizer holding the compiled rules.
+     * @param text Raw text of the document (blocks separated by U+2029).
+     * @param blockCount Amount of blocks in the document.
+     */
+    QCodeEditorHighlightJob(const QSyntaxTokenizer& tokenizer, const QString& text, int blockCount);
+
+    /**
+     * Specifies the blocks to tokenize first.
+     * @param first First visible block.
+     * @param last Last visible block.
+     * @param state State of the block before the first visible block.
+     */
+    void setPriorityRange(int first, int last, int state);
+
+    /**
+     * Runs the job on the global thread pool.
+     * @param job Job to run.
+     */
+    static void start(const QSharedPointer<QCodeEditorHighlightJob>& job);
+
+    /**
+     * Stops the job as soon as possible; no more results are published.
+     */
+    void cancel();
+
+    /**
+     * @return True if the job was cancelled.
+     */
+    bool isCancelled() const;
+
+    /**
+     * @return True if the job ended and all results were taken.
+     */
+    bool isFinished() const;
+
+    /**
+     * Takes all results published so far.
+     * @return Results in the order they should be applied.
+     */
+    QVector<Item> takeResults();
+
+    /**
+     * Tokenizes the snapshot; called on the worker thread.
+     */
+    void run();
+
+private:
+    void tokenizeAll();
+    void publish(QVector<Item>& batch);
+    QString blockText(const QVector<int>& starts, int block) const;
+
+    QSyntaxTokenizer _tokenizer;
+    QString _text;
+    int _blockCount;
+    int _firstPriority;
+    int _lastPriority;
+    int _priorityState;
+    QAtomicInt _cancelled;
+    QAtomicInt _done;
+    mutable QMutex _mutex;
+    QVector<Item> _results;
+};
+
+#endif
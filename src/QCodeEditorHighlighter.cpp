@@ -16,40 +16,701 @@
  * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <QList>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMetaMethod>
 #include <QRegularExpression>
 #include <QTextCharFormat>
+#include <QTextDocument>
+#include <QTextLayout>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QTimer>
 
 #include <QCodeEditor/QCodeEditor.hpp>
 #include <QCodeEditor/QCodeEditorHighlighter.hpp>
 #include <QCodeEditor/QSyntaxRule.hpp>
+#include "QCodeEditorHighlightJob.hpp"
+#include "QCodeEditorParallelJob.hpp"
+
+#include <algorithm>
+
+// background mode: blocks highlighted synchronously per event loop iteration
+static const int SyncBlockBudget = 256;
+// background mode: time spent applying results per timer tick
+static const int ApplyBudgetMs = 8;
+// background mode: interval in which published results are applied
+static const int ApplyIntervalMs = 5;
+// background mode: delay before restarting the job after an edit
+static const int RestartDelayMs = 100;
+// lazy mode: state of blocks that were not highlighted yet
+static const int PendingState = -2;
+// lazy mode: distance between two checkpoints in blocks
+static const int CheckpointInterval = 128;
+// cache: default capacity in bytes
+static const int DefaultCacheSize = 4 * 1024 * 1024;
+// cache: maximum length of a cached line
+static const int MaxCachedLength = 1000;
+
+static bool moreTime(const QPair<qint64, int>& a, const QPair<qint64, int>& b)
+{
+    return a.first > b.first;
+}
+
+// everything about a rule that affects the spans, but not their formats
+static QString matchingSignature(const QSyntaxRule& rule)
+{
+    QStringList signature;
+    signature << rule.regex() << rule.openingRegex() << rule.closingRegex()
+              << rule.keywords().join(' ')
+              << QString("%0%1%2%3%4").arg(int(rule.isGlobal())).arg(int(rule.id().isEmpty()))
+                     .arg(int(rule.keywordsAtLineBegin())).arg(int(rule.keywordCaseSensitivity()))
+                     .arg(int(rule.isExclusive()));
+
+    for (const QSyntaxGroup& group : rule.groups()) {
+        signature << group.name() + QString::number(group.index());
+    }
+
+    return signature.join(QChar(0x1F));
+}
+
+// whether the block was formatted by one of the flagged rules
+static bool containsRule(const QCodeEditorBlockData* data, const QVector<bool>& rules)
+{
+    if (data == nullptr) {
+        return false;
+    }
+
+    for (const QSyntaxSpan& span : data->spans) {
+        if (span.rule < rules.size() && rules.at(span.rule)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// removes the spans of the flagged rules and of rules that do not exist anymore
+static void removeSpans(QCodeEditorBlockData* data, const QVector<bool>& rules)
+{
+    if (data == nullptr) {
+        return;
+    }
+
+    for (int i = data->spans.size() - 1; i >= 0; --i) {
+        const int rule = data->spans.at(i).rule;
+        if (rule >= rules.size() || rules.at(rule)) {
+            data->spans.remove(i);
+        }
+    }
+}
 
 QCodeEditorHighlighter::QCodeEditorHighlighter(QCodeEditor* parent)
     : QSyntaxHighlighter(parent->document())
     , _rules(&parent->rules())
     , _design(&parent->design())
     , _parent(parent)
+    , _rulesChanged(true)
+    , _combine(false)
+    , _mode(SynchronousMode)
+    , _applyIndex(0)
+    , _precomputed(nullptr)
+    , _precomputedBlock(-1)
+    , _precomputedCount(0)
+    , _syncBlocks(0)
+    , _applying(false)
+    , _applyTimer(new QTimer(this))
+    , _restartTimer(new QTimer(this))
+    , _budgetTimer(new QTimer(this))
+    , _lazyMargin(50)
+    , _viewportTimer(new QTimer(this))
+    , _viewportFirst(-1)
+    , _viewportLast(-1)
+    , _sliceBudget(8)
+    , _sliceCursor(0)
+    , _sliceEnd(0)
+    , _blockCount(parent->document()->blockCount())
+    , _sliceTimer(new QTimer(this))
+    , _maxColumn(0)
+    , _blockBudget(0)
+    , _matchLimit(0)
+    , _documentBudget(0)
+    , _documentLimited(false)
+    , _limitedBlock(-1)
+    , _profiling(false)
+    , _reformatting(false)
+    , _formatting(false)
+    , _cache(DefaultCacheSize)
+    , _generation(0)
+    , _cacheHits(0)
+    , _cacheMisses(0)
+    , _nextBlockId(0)
+    , _flushTimer(new QTimer(this))
 {
+    qRegisterMetaType<QCodeEditorMatchDelta>("QCodeEditorMatchDelta");
+    qRegisterMetaType<QVector<QCodeEditorMatchDelta>>("QVector<QCodeEditorMatchDelta>");
+    qRegisterMetaType<QSyntaxBlockResult::Limit>("QSyntaxBlockResult::Limit");
+
+    _applyTimer->setInterval(ApplyIntervalMs);
+    _restartTimer->setInterval(RestartDelayMs);
+    _restartTimer->setSingleShot(true);
+    _budgetTimer->setInterval(0);
+    _budgetTimer->setSingleShot(true);
+    _viewportTimer->setInterval(0);
+    _viewportTimer->setSingleShot(true);
+    _sliceTimer->setInterval(0);
+    _sliceTimer->setSingleShot(true);
+    _flushTimer->setInterval(0);
+    _flushTimer->setSingleShot(true);
+    _parallelStats.ranges = 0;
+    _parallelStats.fixedRanges = 0;
+    _parallelStats.workTime = 0;
+    _parallelStats.wallTime = 0;
+    resetProfile();
+
+    connect(_applyTimer, SIGNAL(timeout()), this, SLOT(applyResults()));
+    connect(_restartTimer, SIGNAL(timeout()), this, SLOT(startJob()));
+    connect(_budgetTimer, SIGNAL(timeout()), this, SLOT(resetSyncBudget()));
+    connect(_viewportTimer, SIGNAL(timeout()), this, SLOT(highlightViewport()));
+    connect(_sliceTimer, SIGNAL(timeout()), this, SLOT(highlightSlice()));
+    connect(_flushTimer, SIGNAL(timeout()), this, SLOT(flushMatches()));
+    connect(parent, SIGNAL(updateRequest(QRect,int)), this, SLOT(viewportUpdated(QRect,int)));
+    connect(document(), SIGNAL(contentsChange(int,int,int)), this, SLOT(documentChanged(int,int,int)));
+}
+
+QCodeEditorHighlighter::~QCodeEditorHighlighter()
+{
+    cancelJob();
 }
 
 void QCodeEditorHighlighter::updateFormats()
 {
+    if (_rulesChanged) {
+        compileRules();
+    }
+
     _formats.clear();
+    _groupFormats.clear();
 
     for (const QSyntaxRule &rule : _parent->rules()) {
-        QTextCharFormat format;
-        if (rule.useFont()) {
-            format.setFont(rule.font());
-        } else {
-            format.setFont(_parent->font());
-        } if (rule.foreColor().alpha() == 0) {
-            format.setForeground(QBrush(_parent->design().editorTextColor()));
-        } else {
-            format.setForeground(rule.foreColor());
-        }
-
-        format.setBackground(QBrush(rule.backColor()));
+        const QTextCharFormat format = createFormat(rule.useFont(), rule.font(), rule.foreColor(), rule.backColor());
         _formats.push_back(format);
+
+        QList<QTextCharFormat> groupFormats;
+        for (const QSyntaxGroup& group : rule.groups()) {
+            groupFormats.push_back(createGroupFormat(format, group));
+        }
+
+        _groupFormats.push_back(groupFormats);
+    }
+}
+
+QTextCharFormat QCodeEditorHighlighter::createFormat(bool useFont, const QFont& font,
+                                                     const QColor& foreColor, const QColor& backColor) const
+{
+    QTextCharFormat format;
+    if (useFont) {
+        format.setFont(font);
+    } else {
+        format.setFont(_parent->font());
+    } if (foreColor.alpha() == 0) {
+        format.setForeground(QBrush(_parent->design().editorTextColor()));
+    } else {
+        format.setForeground(foreColor);
+    }
+
+    format.setBackground(QBrush(backColor));
+    return format;
+}
+
+QTextCharFormat QCodeEditorHighlighter::createGroupFormat(const QTextCharFormat& ruleFormat,
+                                                          const QSyntaxGroup& group) const
+{
+    // the group only overrides what it specifies, e.g. a bold rule stays bold
+    QTextCharFormat groupFormat;
+    if (group.useFont()) {
+        groupFormat.setFont(group.font());
+    }
+
+    if (group.foreColor().alpha() != 0) {
+        groupFormat.setForeground(group.foreColor());
+    }
+
+    if (group.backColor().alpha() != 0) {
+        groupFormat.setBackground(group.backColor());
+    }
+
+    QTextCharFormat format = ruleFormat;
+    format.merge(groupFormat);
+    return format;
+}
+
+void QCodeEditorHighlighter::invalidateRules()
+{
+    _rulesChanged = true;
+}
+
+const QVector<QCompiledSyntaxRule>& QCodeEditorHighlighter::compiledRules() const
+{
+    return _tokenizer.rules();
+}
+
+const QSyntaxTokenizer& QCodeEditorHighlighter::tokenizer() const
+{
+    return _tokenizer;
+}
+
+int QCodeEditorHighlighter::cacheSize() const
+{
+    return _cache.maxCost();
+}
+
+void QCodeEditorHighlighter::setCacheSize(int bytes)
+{
+    _cache.setMaxCost(qMax(0, bytes));
+}
+
+quint64 QCodeEditorHighlighter::cacheHits() const
+{
+    return _cacheHits;
+}
+
+quint64 QCodeEditorHighlighter::cacheMisses() const
+{
+    return _cacheMisses;
+}
+
+void QCodeEditorHighlighter::resetCacheCounters()
+{
+    _cacheHits = 0;
+    _cacheMisses = 0;
+}
+
+bool QCodeEditorHighlighter::combinedMatching() const
+{
+    return _combine;
+}
+
+void QCodeEditorHighlighter::setCombinedMatching(bool enabled)
+{
+    if (_combine == enabled) {
+        return;
+    }
+
+    _combine = enabled;
+    if (!_rulesChanged) {
+        // the rules are compiled already; only the tokenizer changes
+        cancelJob();
+        _checkpoints.clear();
+        createTokenizer(_tokenizer.rules());
+        updateGeneration();
+        requestRehighlight();
+    }
+}
+
+QCodeEditorHighlighter::HighlightMode QCodeEditorHighlighter::highlightMode() const
+{
+    return _mode;
+}
+
+void QCodeEditorHighlighter::setHighlightMode(HighlightMode mode)
+{
+    if (_mode != mode) {
+        cancelJob();
+        _checkpoints.clear();
+        _sliceTimer->stop();
+        _sliceCursor = _sliceEnd = 0;
+        _mode = mode;
+    }
+}
+
+int QCodeEditorHighlighter::lazyMargin() const
+{
+    return _lazyMargin;
+}
+
+void QCodeEditorHighlighter::setLazyMargin(int blocks)
+{
+    _lazyMargin = qMax(0, blocks);
+}
+
+int QCodeEditorHighlighter::sliceBudget() const
+{
+    return _sliceBudget;
+}
+
+void QCodeEditorHighlighter::setSliceBudget(int ms)
+{
+    _sliceBudget = qMax(1, ms);
+}
+
+int QCodeEditorHighlighter::maxColumn() const
+{
+    return _maxColumn;
+}
+
+void QCodeEditorHighlighter::setMaxColumn(int column)
+{
+    _maxColumn = qMax(0, column);
+    _tokenizer.setLimits(_maxColumn, _blockBudget);
+    updateGeneration();
+}
+
+int QCodeEditorHighlighter::blockBudget() const
+{
+    return _blockBudget;
+}
+
+void QCodeEditorHighlighter::setBlockBudget(int ms)
+{
+    _blockBudget = qMax(0, ms);
+    _tokenizer.setLimits(_maxColumn, _blockBudget);
+    updateGeneration();
+}
+
+int QCodeEditorHighlighter::matchLimit() const
+{
+    return _matchLimit;
+}
+
+void QCodeEditorHighlighter::setMatchLimit(int steps)
+{
+    if (_matchLimit == qMax(0, steps)) {
+        return;
+    }
+
+    _matchLimit = qMax(0, steps);
+    if (!_rulesChanged) {
+        compileRules();
+    }
+}
+
+int QCodeEditorHighlighter::documentBudget() const
+{
+    return _documentBudget;
+}
+
+void QCodeEditorHighlighter::setDocumentBudget(int ms)
+{
+    _documentBudget = qMax(0, ms);
+}
+
+bool QCodeEditorHighlighter::profiling() const
+{
+    return _profiling;
+}
+
+void QCodeEditorHighlighter::setProfiling(bool enabled)
+{
+    _profiling = enabled;
+    _tokenizer.setProfiling(enabled);
+}
+
+QSyntaxRuleProfile QCodeEditorHighlighter::ruleProfile(int rule) const
+{
+    return _tokenizer.profile(rule);
+}
+
+const QCodeEditorHighlighter::BlockProfile& QCodeEditorHighlighter::blockProfile() const
+{
+    return _blockProfile;
+}
+
+void QCodeEditorHighlighter::resetProfile()
+{
+    _tokenizer.resetCounters();
+    _blockProfile.blocks = 0;
+    _blockProfile.time = 0;
+    _blockProfile.maxTime = 0;
+    _blockProfile.slowestBlock = -1;
+}
+
+QString QCodeEditorHighlighter::profileReport() const
+{
+    // the most expensive rules first
+    QVector<QPair<qint64, int>> order;
+    for (int i = 0; i < _tokenizer.rules().size() && i < _rules->size(); ++i) {
+        order.push_back(qMakePair(_tokenizer.profile(i).time, i));
+    }
+
+    std::stable_sort(order.begin(), order.end(), moreTime);
+
+    QString report;
+    QTextStream stream(&report);
+    stream << "rule\tid\tinvocations\tmatches\tbytes\ttime [us]\n";
+
+    for (const auto& entry : order) {
+        const int rule = entry.second;
+        const QSyntaxRuleProfile profile = _tokenizer.profile(rule);
+        const QSyntaxRule& syntaxRule = _rules->at(rule);
+        const QString id = syntaxRule.id().isEmpty() ? syntaxRule.regex().left(32) : syntaxRule.id();
+        stream << rule << '\t' << id << '\t' << profile.invocations << '\t' << profile.matches << '\t'
+               << profile.bytesScanned << '\t' << profile.time / 1000 << '\n';
+    }
+
+    const QSyntaxRuleProfile combined = _tokenizer.combinedProfile();
+    if (combined.invocations > 0) {
+        stream << "merged\t\t" << combined.invocations << "\t\t" << combined.bytesScanned << '\t'
+               << combined.time / 1000 << '\n';
+    }
+
+    stream << "\nblocks: " << _blockProfile.blocks
+           << ", time: " << _blockProfile.time / 1000 << " us"
+           << ", slowest: block " << _blockProfile.slowestBlock
+           << " (" << _blockProfile.maxTime / 1000 << " us)\n";
+
+    stream.flush();
+    return report;
+}
+
+bool QCodeEditorHighlighter::saveProfileReport(const QString& path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    return file.write(profileReport().toUtf8()) != -1;
+}
+
+const QCodeEditorHighlighter::ParallelStatistics& QCodeEditorHighlighter::parallelStatistics() const
+{
+    return _parallelStats;
+}
+
+bool QCodeEditorHighlighter::isFormatting() const
+{
+    return _formatting;
+}
+
+void QCodeEditorHighlighter::requestRehighlight()
+{
+    if (_mode == BackgroundMode) {
+        startJob();
+    } else if (_mode == TimeSlicedMode) {
+        _sliceCursor = 0;
+        _sliceEnd = 0;
+        scheduleSlice(0, document()->blockCount());
+    } else if (_mode == ParallelMode) {
+        rehighlightParallel();
+    } else if (_mode == LazyMode) {
+        rehighlightLazily();
+    } else {
+        formatDocument();
+    }
+}
+
+void QCodeEditorHighlighter::rehighlightLazily()
+{
+    // only marks the blocks; their formats stay until they become visible,
+    // which does not lay out the entire document like rehighlight() does.
+    _checkpoints.clear();
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        block.setUserState(PendingState);
+    }
+
+    highlightViewport();
+}
+
+void QCodeEditorHighlighter::compileRules()
+{
+    QVector<QCompiledSyntaxRule> compiledRules;
+    compiledRules.reserve(_rules->size());
+    QStringList signature;
+
+    for (const QSyntaxRule& rule : *_rules) {
+        QCompiledSyntaxRule compiled(rule, _matchLimit);
+        if (!compiled.isValid()) {
+            qWarning() << "Rule" << rule.id() << "is ignored:" << compiled.errorString();
+            emit onRuleError(rule, compiled.errorString());
+        }
+
+        compiledRules.push_back(compiled);
+        signature << matchingSignature(rule);
+    }
+
+    signature << QString::number(_matchLimit);
+    _signature = signature.join(QChar(0x1F));
+
+    // results of the running job and checkpoints refer to the old rules
+    cancelJob();
+    _checkpoints.clear();
+    createTokenizer(compiledRules);
+    _rulesChanged = false;
+    updateGeneration();
+}
+
+void QCodeEditorHighlighter::reloadRules(const QList<QSyntaxRule>& previous)
+{
+    // without compiled rules or with a different amount of rules, the
+    // rules can not be compared by their index.
+    if (_rulesChanged || previous.size() != _rules->size()) {
+        invalidateRules();
+        updateFormats();
+        dropSpans(QVector<bool>());
+        requestRehighlight();
+        return;
+    }
+
+    // compiling the rules cancels the running job; the blocks it did not
+    // deliver yet would keep their old highlighting otherwise.
+    const bool deferred = !_job.isNull() || _restartTimer->isActive();
+
+    const QList<QTextCharFormat> formats = _formats;
+    const QVector<QList<QTextCharFormat>> groupFormats = _groupFormats;
+    QVector<bool> matching(_rules->size(), false);
+    bool matchingChanged = false;
+
+    for (int i = 0; i < _rules->size(); ++i) {
+        if (matchingSignature(previous.at(i)) != matchingSignature(_rules->at(i))) {
+            matching[i] = true;
+            matchingChanged = true;
+        }
+    }
+
+    if (matchingChanged) {
+        invalidateRules();
+    }
+
+    updateFormats();
+
+    // rules matching differently are highlighted anyway
+    QVector<bool> formatting = changedFormats(formats, groupFormats);
+    for (int i = 0; i < formatting.size(); ++i) {
+        formatting[i] = formatting.at(i) && !matching.at(i);
+    }
+
+    reformatBlocks(formatting);
+    if (matchingChanged && deferred) {
+        dropSpans(matching);
+        requestRehighlight();
+    } else if (matchingChanged) {
+        rehighlightRules(matching);
+    }
+}
+
+void QCodeEditorHighlighter::reapplyFormats()
+{
+    reformatBlocks(QVector<bool>(_formats.size(), true));
+}
+
+void QCodeEditorHighlighter::applyDesign()
+{
+    const QList<QTextCharFormat> formats = _formats;
+    const QVector<QList<QTextCharFormat>> groupFormats = _groupFormats;
+
+    updateFormats();
+    reformatBlocks(changedFormats(formats, groupFormats));
+}
+
+QVector<bool> QCodeEditorHighlighter::changedFormats(const QList<QTextCharFormat>& formats,
+                                                     const QVector<QList<QTextCharFormat>>& groupFormats) const
+{
+    QVector<bool> changed(_formats.size(), false);
+    for (int i = 0; i < _formats.size(); ++i) {
+        changed[i] = i >= formats.size() || i >= groupFormats.size()
+                  || formats.at(i) != _formats.at(i) || groupFormats.at(i) != _groupFormats.at(i);
+    }
+
+    return changed;
+}
+
+void QCodeEditorHighlighter::reformatBlocks(const QVector<bool>& rules)
+{
+    if (!rules.contains(true)) {
+        return;
+    }
+
+    _reformatting = true;
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        // pending blocks are plain, even though they might still have data
+        if (block.userState() != PendingState
+                && containsRule(static_cast<QCodeEditorBlockData*>(block.userData()), rules)) {
+            formatBlock(block);
+        }
+    }
+
+    _reformatting = false;
+}
+
+void QCodeEditorHighlighter::rehighlightRules(const QVector<bool>& rules)
+{
+    // rules without required literals or spanning several lines might
+    // start matching in any block.
+    for (int i = 0; i < rules.size(); ++i) {
+        const QCompiledSyntaxRule& rule = _tokenizer.rules().at(i);
+        if (rules.at(i) && rule.isValid() && (!rule.hasPrefilter() || rule.isMultiLine())) {
+            dropSpans(rules);
+            requestRehighlight();
+            return;
+        }
+    }
+
+    // highlights the blocks the old rules matched in and those the new
+    // rules may match in; state changes continue with the next blocks.
+    // The spans of the old rules are removed beforehand, since blocks that
+    // are pending or deferred keep their data until highlighted later.
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        auto data = static_cast<QCodeEditorBlockData*>(block.userData());
+        bool touched = containsRule(data, rules);
+        removeSpans(data, rules);
+
+        if (_mode == LazyMode && block.userState() == PendingState) {
+            continue;
+        }
+
+        for (int i = 0; i < rules.size() && !touched; ++i) {
+            touched = rules.at(i) && _tokenizer.rules().at(i).mayMatch(block.text());
+        }
+
+        if (touched) {
+            formatBlock(block);
+        }
+    }
+}
+
+void QCodeEditorHighlighter::formatBlock(const QTextBlock& block)
+{
+    // the document reports formatted blocks as changed contents
+    const bool formatting = _formatting;
+    _formatting = true;
+    rehighlightBlock(block);
+    _formatting = formatting;
+}
+
+void QCodeEditorHighlighter::formatDocument()
+{
+    const bool formatting = _formatting;
+    _formatting = true;
+    rehighlight();
+    _formatting = formatting;
+}
+
+void QCodeEditorHighlighter::dropSpans(const QVector<bool>& rules)
+{
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        removeSpans(static_cast<QCodeEditorBlockData*>(block.userData()), rules);
+    }
+}
+
+void QCodeEditorHighlighter::createTokenizer(const QVector<QCompiledSyntaxRule>& rules)
+{
+    _tokenizer = QSyntaxTokenizer(rules, _combine);
+    _tokenizer.setLimits(_maxColumn, _blockBudget);
+    _tokenizer.setProfiling(_profiling);
+}
+
+void QCodeEditorHighlighter::updateGeneration()
+{
+    // results cached for other rules age out of the cache; only the
+    // current signature is kept to notice changes that change nothing.
+    const QString key = _signature + QChar(0x1F) + QString::number(int(_combine))
+                      + QChar(0x1F) + QString::number(_maxColumn)
+                      + QChar(0x1F) + QString::number(_blockBudget);
+    if (key != _generationKey) {
+        _generationKey = key;
+        ++_generation;
     }
 }
 
@@ -60,129 +721,623 @@ void QCodeEditorHighlighter::highlight(int start, int length, const QTextCharFor
 
 void QCodeEditorHighlighter::highlightBlock(const QString &text)
 {
-    if (currentBlockUserData() != nullptr) {
-        auto d = static_cast<QCodeEditorBlockData*>(currentBlockUserData());
-        QRegularExpression regex(d->re);
-        if (!regex.match(text).hasMatch()) {
-            onRemove(d);
+    if (!_profiling) {
+        highlightText(text);
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    highlightText(text);
+    recordBlock(timer.nsecsElapsed());
+}
+
+void QCodeEditorHighlighter::recordBlock(qint64 time)
+{
+    _blockProfile.blocks += 1;
+    _blockProfile.time += time;
+    if (time > _blockProfile.maxTime) {
+        _blockProfile.maxTime = time;
+        _blockProfile.slowestBlock = currentBlock().blockNumber();
+    }
+
+    // deferred and lazily skipped blocks might not have any data
+    auto data = static_cast<QCodeEditorBlockData*>(currentBlockUserData());
+    if (data != nullptr) {
+        data->highlightTime = time;
+    }
+}
+
+void QCodeEditorHighlighter::highlightText(const QString& text)
+{
+    if (_reformatting) {
+        // keeps the state and matches, only the formats change
+        auto data = static_cast<QCodeEditorBlockData*>(currentBlockUserData());
+        if (data != nullptr) {
+            applyFormats(data->spans);
+        }
+
+        emit onHighlight(this);
+        return;
+    }
+
+    if (_precomputed != nullptr) {
+        const int index = currentBlock().blockNumber() - _precomputedBlock;
+        if (index >= 0 && index < _precomputedCount) {
+            applyResult(text, _precomputed[index]);
+            return;
+        }
+    }
+
+    if (_mode == LazyMode) {
+        int first, last;
+        visibleBlocks(&first, &last);
+
+        const int number = currentBlock().blockNumber();
+        if (number < first - _lazyMargin || number > last + _lazyMargin) {
+            // stays plain until it is scrolled into view
+            dropCheckpoints(number);
+            setCurrentBlockState(PendingState);
+            return;
+        }
+
+        if (exceedsDocumentBudget()) {
+            // highlighted again once the viewport is updated
+            QSyntaxBlockResult result;
+            result.state = PendingState;
+            result.limit = QSyntaxBlockResult::DocumentTimeLimit;
+            applyResult(text, result);
+            return;
+        }
+
+        int state = previousBlockState();
+        if (state == PendingState) {
+            state = resolveState(currentBlock());
         }
+
+        applyResult(text, tokenize(text, state));
+        return;
     }
 
-    int ruleIndex = 0;
-    setCurrentBlockState(-1);
+    if (_mode == TimeSlicedMode) {
+        if (_syncBlocks++ == 0) {
+            _sliceClock.start();
+            _budgetTimer->start();
+        }
 
-    for (const auto& rule : *_rules) {
-        const auto &format = _formats.at(ruleIndex);
-        QRegularExpression regex(rule.regex());
-        QRegularExpressionMatch match;
+        const int number = currentBlock().blockNumber();
+        if (_sliceClock.elapsed() >= _sliceBudget) {
+            // keeps the formatting and the state, which ends the current
+            // pass; one of the next slices continues with this block.
+            deferBlock();
+            scheduleSlice(number, number + 1);
+            return;
+        } else if (number == _sliceCursor && _sliceCursor < _sliceEnd) {
+            ++_sliceCursor;
+        }
+    }
 
-        if (rule.isGlobal()) {
-            // searches for more than one match
-            QRegularExpressionMatchIterator iter = regex.globalMatch(text);
-            if (iter.hasNext() && !rule.closingRegex().isEmpty() && currentBlockState() == -1) {
-                setCurrentBlockState(ruleIndex);
+    if (_mode == BackgroundMode) {
+        // blocks reached while applying results are delivered by the job
+        // as well; other blocks are highlighted right away as long as the
+        // budget allows, so that typing is not delayed.
+        if (_applying || _syncBlocks >= SyncBlockBudget) {
+            deferBlock();
+            if (_job.isNull() && !_restartTimer->isActive()) {
+                _restartTimer->start();
             }
 
-            // iterates through all other matches and highlights them
-            while (iter.hasNext()) {
-                match = iter.next();
-                setFormat(match.capturedStart(), match.capturedLength(), format);
-                if (!rule.id().isEmpty()) {
-                    if (currentBlockUserData() == nullptr) {
-                        setCurrentBlockUserData(new QCodeEditorBlockData(rule.regex()));
-                        emit onMatch(rule, match.captured(), currentBlock());
-                    } else {
-                        auto d = static_cast<QCodeEditorBlockData*>(currentBlockUserData());
-                        if (d->re == rule.regex()) {
-                            emit onRemove(d);
-                            setCurrentBlockUserData(new QCodeEditorBlockData(rule.regex()));
-                            emit onMatch(rule, match.captured(), currentBlock());
-                        }
-                    }
-                }
+            return;
+        } else if (_syncBlocks++ == 0) {
+            _budgetTimer->start();
+        }
+    } else if (_mode != TimeSlicedMode && exceedsDocumentBudget()) {
+        // keeps the stored state, so that the following blocks are not
+        // highlighted in the same pass as well.
+        QSyntaxBlockResult result;
+        result.state = currentBlockState();
+        result.limit = QSyntaxBlockResult::DocumentTimeLimit;
+        applyResult(text, result);
+        return;
+    }
+
+    applyResult(text, tokenize(text, previousBlockState()));
+}
+
+void QCodeEditorHighlighter::startJob()
+{
+    cancelJob();
+    _restartTimer->stop();
+
+    QTextDocument* doc = document();
+    if (doc == nullptr || _mode != BackgroundMode) {
+        return;
+    }
+
+    _job = QSharedPointer<QCodeEditorHighlightJob>(
+        new QCodeEditorHighlightJob(_tokenizer, doc->toRawText(), doc->blockCount()));
+
+    int first, last;
+    visibleBlocks(&first, &last);
+    _job->setPriorityRange(first, last, doc->findBlockByNumber(first).previous().userState());
+
+    QCodeEditorHighlightJob::start(_job);
+    _applyTimer->start();
+}
+
+void QCodeEditorHighlighter::cancelJob()
+{
+    if (!_job.isNull()) {
+        _job->cancel();
+        _job.clear();
+    }
+
+    _applyQueue.clear();
+    _applyBlocks.clear();
+    _applyIndex = 0;
+    _applyTimer->stop();
+}
+
+void QCodeEditorHighlighter::applyResults()
+{
+    if (_job.isNull()) {
+        _applyTimer->stop();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!_job.isNull() && timer.elapsed() < ApplyBudgetMs) {
+        if (_applyIndex >= _applyQueue.size()) {
+            _applyQueue.clear();
+            _applyBlocks.clear();
+            _applyIndex = 0;
+
+            for (const auto& item : _job->takeResults()) {
+                _applyBlocks.push_back(item.block);
+                _applyQueue.push_back(item.result);
             }
-        } else {
-            match = regex.match(text);
-            if (match.hasMatch()) {
-                if (!rule.closingRegex().isEmpty() && currentBlockState() == -1) {
-                    // before setting the multiline trigger, checks if the
-                    // closing sequence is on the same line.
-                    QRegularExpression mulEnd(rule.closingRegex());
-                    if (!mulEnd.match(text).hasMatch())
-                        setCurrentBlockState(ruleIndex);
-                } if (!rule.id().isEmpty()) {
-                    if (currentBlockUserData() == nullptr) {
-                        setCurrentBlockUserData(new QCodeEditorBlockData(rule.regex()));
-                        emit onMatch(rule, match.captured(), currentBlock());
-                    } else {
-                        auto d = static_cast<QCodeEditorBlockData *>(currentBlockUserData());
-                        if (d->re == rule.regex()) {
-                            emit onRemove(d);
-                            setCurrentBlockUserData(new QCodeEditorBlockData(rule.regex()));
-                            emit onMatch(rule, match.captured(), currentBlock());
-                        }
-                    }
-                }
-                setFormat(match.capturedStart(), match.capturedLength(), format);
+
+            if (_applyQueue.isEmpty()) {
+                break;
             }
         }
-        ++ruleIndex;
-    }
-
-    // if there was a multi-line-rule match in the previous block, we need to
-    // check against its closing regex.
-    if (previousBlockState() != -1) {
-        const auto& rule = _rules->at(previousBlockState());
-        const auto format = _formats.at(previousBlockState());
-        QRegularExpression regex(rule.closingRegex());
-        QRegularExpressionMatch match = regex.match(text);
-
-        // If now has a match, ends the multi-line regex
-        if (match.hasMatch()) {
-            setFormat(match.capturedStart(), match.capturedLength(), format);
-            setCurrentBlockState(-1);
-
-            if (!rule.id().isEmpty()) {
-                if (currentBlockUserData() == nullptr) {
-                    setCurrentBlockUserData(new QCodeEditorBlockData(rule.regex()));
-                    emit onMatch(rule, match.captured(), currentBlock());
-                } else {
-                    auto d = static_cast<QCodeEditorBlockData*>(currentBlockUserData());
-                    if (d->re == rule.regex()) {
-                        // Already containing a match that has the exact regex:
-                        // Remove it first, then add it again
-                        emit onRemove(d);
-                        setCurrentBlockUserData(new QCodeEditorBlockData(rule.regex()));
-                        emit onMatch(rule, match.captured(), currentBlock());
-                    }
-                }
+
+        // copies the result, since a listener might edit the document
+        // and thereby cancel the job while the block is highlighted.
+        const QSyntaxBlockResult result = _applyQueue.at(_applyIndex);
+        const int blockNumber = _applyBlocks.at(_applyIndex);
+        ++_applyIndex;
+
+        QTextBlock block = document()->findBlockByNumber(blockNumber);
+        if (block.isValid()) {
+            _applying = true;
+            _precomputed = &result;
+            _precomputedBlock = blockNumber;
+            _precomputedCount = 1;
+            formatBlock(block);
+            _precomputed = nullptr;
+            _applying = false;
+        }
+    }
+
+    if (!_job.isNull() && _applyIndex >= _applyQueue.size() && _job->isFinished()) {
+        cancelJob();
+    }
+}
+
+void QCodeEditorHighlighter::resetSyncBudget()
+{
+    _syncBlocks = 0;
+    _documentLimited = false;
+
+    if (_limitedBlock != -1) {
+        highlightLimited();
+    }
+}
+
+void QCodeEditorHighlighter::highlightLimited()
+{
+    const int first = _limitedBlock;
+    _limitedBlock = -1;
+
+    // pending blocks are highlighted along with the viewport
+    if (_mode == LazyMode) {
+        _viewportTimer->start();
+        return;
+    }
+
+    // continues with the blocks the document budget cut off, until the
+    // budget of this event loop iteration cuts off another one.
+    QTextBlock block = document()->findBlockByNumber(first);
+    while (block.isValid() && _limitedBlock == -1) {
+        auto data = static_cast<QCodeEditorBlockData*>(block.userData());
+        if (data != nullptr && data->limit == QSyntaxBlockResult::DocumentTimeLimit) {
+            formatBlock(block);
+        }
+
+        block = block.next();
+    }
+}
+
+void QCodeEditorHighlighter::highlightViewport()
+{
+    if (_mode != LazyMode) {
+        return;
+    }
+
+    int first, last;
+    visibleBlocks(&first, &last);
+    _viewportFirst = first;
+    _viewportLast = last;
+
+    // highlights all blocks that were scrolled into view. Highlighting a
+    // block might continue with the next ones, which are skipped then.
+    QTextBlock block = document()->findBlockByNumber(qMax(0, first - _lazyMargin));
+    for (int i = qMax(0, first - _lazyMargin); block.isValid() && i <= last + _lazyMargin; ++i) {
+        if (block.userState() == PendingState) {
+            formatBlock(block);
+        }
+
+        block = block.next();
+    }
+}
+
+void QCodeEditorHighlighter::viewportUpdated(const QRect& rect, int dy)
+{
+    Q_UNUSED(rect);
+    if (_mode != LazyMode) {
+        return;
+    }
+
+    // repaints of the cursor or of edited lines do not reveal any blocks
+    int first, last;
+    visibleBlocks(&first, &last);
+    if (dy != 0 || first != _viewportFirst || last != _viewportLast) {
+        _viewportTimer->start();
+    }
+}
+
+void QCodeEditorHighlighter::highlightSlice()
+{
+    if (_mode != TimeSlicedMode) {
+        return;
+    }
+
+    _sliceEnd = qMin(_sliceEnd, document()->blockCount());
+    _sliceClock.start();
+    _syncBlocks = 1;
+
+    // highlighting a block continues with the next blocks as long as their
+    // state changes and the budget allows; each one advances the cursor.
+    QTextBlock block = document()->findBlockByNumber(_sliceCursor);
+    while (block.isValid() && _sliceCursor < _sliceEnd && _sliceClock.elapsed() < _sliceBudget) {
+        formatBlock(block);
+        block = document()->findBlockByNumber(_sliceCursor);
+    }
+
+    _syncBlocks = 0;
+
+    if (_sliceCursor < _sliceEnd) {
+        emit onProgress(_sliceCursor, _sliceEnd);
+        _sliceTimer->start();
+    } else {
+        _sliceCursor = _sliceEnd = 0;
+        emit onFinished();
+    }
+}
+
+void QCodeEditorHighlighter::flushMatches()
+{
+    QVector<QCodeEditorMatchDelta> removed;
+    QVector<QCodeEditorMatchDelta> added;
+    removed.swap(_removedMatches);
+    added.swap(_addedMatches);
+
+    if (!removed.isEmpty() || !added.isEmpty()) {
+        emit onMatchesChanged(removed, added);
+    }
+}
+
+void QCodeEditorHighlighter::documentChanged(int position, int charsRemoved, int charsAdded)
+{
+    // formatting a block does not change any text; it neither invalidates
+    // checkpoints nor the results of the running job.
+    if (_formatting && charsRemoved == charsAdded) {
+        return;
+    }
+
+    const int block = document()->findBlock(position).blockNumber();
+    const int delta = document()->blockCount() - _blockCount;
+    _blockCount = document()->blockCount();
+
+    if (_mode == LazyMode) {
+        // the block numbers of the checkpoints might have shifted and
+        // removed blocks might have moved pending ones into view.
+        dropCheckpoints(block);
+        if (delta != 0) {
+            _viewportTimer->start();
+        }
+    }
+
+    if (_mode == TimeSlicedMode && delta != 0 && _sliceCursor < _sliceEnd) {
+        // blocks before the cursor were added or removed; the cursor might
+        // refer to another block now, so it continues at the edit.
+        if (block < _sliceCursor) {
+            _sliceCursor = block;
+        }
+
+        _sliceEnd = qMax(_sliceCursor + 1, _sliceEnd + delta);
+    }
+
+    if (_applying || _mode != BackgroundMode) {
+        return;
+    }
+
+    // the results of the running job refer to the old text
+    if (!_job.isNull()) {
+        cancelJob();
+        _restartTimer->start();
+    }
+}
+
+void QCodeEditorHighlighter::deferBlock()
+{
+    // keeps the current formatting until the block is highlighted later
+    for (const QTextLayout::FormatRange& range : currentBlock().layout()->formats()) {
+        setFormat(range.start, range.length, range.format);
+    }
+}
+
+void QCodeEditorHighlighter::visibleBlocks(int* first, int* last) const
+{
+    // estimates the visible blocks; wrapped lines only make the range larger
+    int lines = _parent->viewport()->height() / qMax(1, _parent->fontMetrics().height());
+    *first = qMax(0, _parent->firstVisibleBlock().blockNumber());
+    *last = *first + lines;
+}
+
+int QCodeEditorHighlighter::resolveState(const QTextBlock& block)
+{
+    const int number = block.blockNumber();
+    int checkpoint = -1;
+    int state = -1;
+
+    // the nearest checkpoint before the block limits the walk back
+    auto it = _checkpoints.lowerBound(number);
+    if (it != _checkpoints.begin()) {
+        --it;
+        checkpoint = it.key();
+        state = it.value();
+    }
+
+    // walks back to the nearest block with a known state
+    QTextBlock known = block.previous();
+    int knownNumber = number - 1;
+    while (known.isValid() && knownNumber > checkpoint && known.userState() == PendingState) {
+        known = known.previous();
+        --knownNumber;
+    }
+
+    QTextBlock current;
+    int currentNumber;
+    if (known.isValid() && knownNumber > checkpoint) {
+        state = known.userState();
+        current = known.next();
+        currentNumber = knownNumber + 1;
+    } else {
+        current = document()->findBlockByNumber(checkpoint + 1);
+        currentNumber = checkpoint + 1;
+    }
+
+    // tokenizes the blocks in between and leaves checkpoints behind
+    while (current.isValid() && currentNumber < number) {
+        state = _tokenizer.tokenize(current.text(), state).state;
+        if (currentNumber % CheckpointInterval == 0) {
+            _checkpoints.insert(currentNumber, state);
+        }
+
+        current = current.next();
+        ++currentNumber;
+    }
+
+    return state;
+}
+
+void QCodeEditorHighlighter::dropCheckpoints(int block)
+{
+    auto it = _checkpoints.lowerBound(block);
+    while (it != _checkpoints.end()) {
+        it = _checkpoints.erase(it);
+    }
+}
+
+void QCodeEditorHighlighter::scheduleSlice(int first, int end)
+{
+    if (_sliceCursor < _sliceEnd) {
+        _sliceCursor = qMin(_sliceCursor, first);
+        _sliceEnd = qMax(_sliceEnd, end);
+    } else {
+        _sliceCursor = first;
+        _sliceEnd = end;
+    }
+
+    _sliceTimer->start();
+}
+
+bool QCodeEditorHighlighter::exceedsDocumentBudget()
+{
+    if (_documentBudget == 0) {
+        return false;
+    }
+
+    // the budget covers all blocks highlighted within one event loop iteration
+    if (_syncBlocks++ == 0) {
+        _sliceClock.start();
+        _budgetTimer->start();
+    }
+
+    return _sliceClock.elapsed() >= _documentBudget;
+}
+
+void QCodeEditorHighlighter::rehighlightParallel()
+{
+    QCodeEditorParallelJob job(_tokenizer, document()->toRawText());
+    job.run(QThreadPool::globalInstance());
+
+    _parallelStats.ranges = job.rangeCount();
+    _parallelStats.fixedRanges = job.fixedRanges();
+    _parallelStats.workTime = job.workTime();
+    _parallelStats.wallTime = job.wallTime();
+
+    // only formats the blocks on this thread
+    _precomputed = job.results().constData();
+    _precomputedBlock = 0;
+    _precomputedCount = job.results().size();
+    formatDocument();
+    _precomputed = nullptr;
+}
+
+QSyntaxBlockResult QCodeEditorHighlighter::tokenize(const QString& text, int state)
+{
+    // long lines are rarely repeated and would evict many short ones
+    if (_cache.maxCost() == 0 || text.size() > MaxCachedLength) {
+        return _tokenizer.tokenize(text, state);
+    }
+
+    CacheKey key = { text, state, _generation };
+    if (const QSyntaxBlockResult* cached = _cache.object(key)) {
+        ++_cacheHits;
+        return *cached;
+    }
+
+    ++_cacheMisses;
+    QSyntaxBlockResult result = _tokenizer.tokenize(text, state);
+
+    // the time a block takes varies, it might not exceed the budget next
+    // time; truncated lines are not worth their memory either.
+    if (result.limit == QSyntaxBlockResult::NoLimit) {
+        const int cost = sizeof(CacheKey) + sizeof(QSyntaxBlockResult)
+                       + text.size() * sizeof(QChar)
+                       + (result.spans.size() + result.matches.size()) * sizeof(QSyntaxSpan);
+        _cache.insert(key, new QSyntaxBlockResult(result), cost);
+    }
+
+    return result;
+}
+
+void QCodeEditorHighlighter::applyResult(const QString& text, const QSyntaxBlockResult& result)
+{
+    static const QMetaMethod matchSignal = QMetaMethod::fromSignal(&QCodeEditorHighlighter::onMatch);
+    static const QMetaMethod batchSignal = QMetaMethod::fromSignal(&QCodeEditorHighlighter::onMatchesChanged);
+    const bool perMatch = isSignalConnected(matchSignal);
+    const bool batched = isSignalConnected(batchSignal);
+    int blockNumber = -1;
+
+    // the matches of the previous highlighting are replaced
+    auto data = static_cast<QCodeEditorBlockData*>(currentBlockUserData());
+    if (data != nullptr && !data->matches.isEmpty()) {
+        if (batched) {
+            blockNumber = currentBlock().blockNumber();
+            for (const auto& match : data->matches) {
+                QCodeEditorMatchDelta delta = { match.rule, blockNumber, -1, 0, match.id };
+                _removedMatches.push_back(delta);
+            }
+        }
+
+        emit onRemove(data);
+        data->matches.clear();
+    }
+
+    setCurrentBlockState(result.state);
+    applyFormats(result.spans);
+
+    if (!result.spans.isEmpty() || result.limit != QSyntaxBlockResult::NoLimit || _profiling) {
+        if (data == nullptr) {
+            data = new QCodeEditorBlockData;
+            setCurrentBlockUserData(data);
+        }
+
+        // shares the spans with the result, they are only copied on write
+        data->spans = result.spans;
+        data->limit = result.limit;
+        if (batched && blockNumber == -1 && !result.matches.isEmpty()) {
+            blockNumber = currentBlock().blockNumber();
+        }
+
+        for (const QSyntaxSpan& match : result.matches) {
+            QCodeEditorBlockData::Match entry = { match.rule, nextBlockId() };
+            data->matches.append(entry);
+
+            if (batched) {
+                QCodeEditorMatchDelta delta = { match.rule, blockNumber, match.start, match.length, entry.id };
+                _addedMatches.push_back(delta);
+            }
+
+            if (perMatch) {
+                emit onMatch(_rules->at(match.rule), text.mid(match.start, match.length), currentBlock());
+            }
+        }
+    } else if (data != nullptr) {
+        // deletes the data, blocks without spans and limits do not need any
+        setCurrentBlockUserData(nullptr);
+    }
+
+    if (result.limit != QSyntaxBlockResult::NoLimit) {
+        if (result.limit != QSyntaxBlockResult::DocumentTimeLimit || !_documentLimited) {
+            emit onLimitExceeded(currentBlock(), result.limitRule, result.limit);
+        }
+
+        if (result.limit == QSyntaxBlockResult::DocumentTimeLimit) {
+            _documentLimited = true;
+
+            // highlighted once the budget is reset
+            const int number = currentBlock().blockNumber();
+            if (_limitedBlock == -1 || number < _limitedBlock) {
+                _limitedBlock = number;
             }
-        } else {
-            // Has no match, highlights the entire line and
-            // forwards the previous state to the next line.
-            setFormat(0, text.length(), format);
-            setCurrentBlockState(previousBlockState());
         }
     }
 
+    if (batched && !_flushTimer->isActive() && (!_removedMatches.isEmpty() || !_addedMatches.isEmpty())) {
+        _flushTimer->start();
+    }
 
     // Provides custom highlighting logic
     emit onHighlight(this);
 }
 
-QList<QUuid> uniqueIds;
-
-QCodeEditorBlockData::QCodeEditorBlockData(QString r)
+void QCodeEditorHighlighter::applyFormats(const QVector<QSyntaxSpan>& spans)
 {
-    do {
-        id = QUuid::createUuid();
-    } while (uniqueIds.contains(id));
+    // spans stored before the rules were reloaded might refer to rules or
+    // groups that do not exist anymore; they are highlighted again later.
+    for (const QSyntaxSpan& span : spans) {
+        if (span.rule < 0 || span.rule >= _formats.size()) {
+            continue;
+        }
+
+        if (span.group == 0) {
+            setFormat(span.start, span.length, _formats.at(span.rule));
+        } else if (span.group <= _groupFormats.at(span.rule).size()) {
+            setFormat(span.start, span.length, _groupFormats.at(span.rule).at(span.group - 1));
+        }
+    }
+}
 
-    uniqueIds.push_back(id);
-    re = r;
+quint64 QCodeEditorHighlighter::nextBlockId()
+{
+    // 64 bits will not overflow within the lifetime of an editor
+    return _nextBlockId.fetchAndAddRelaxed(1) + 1;
 }
 
-QCodeEditorBlockData::~QCodeEditorBlockData()
+const QCodeEditorBlockData::Match* QCodeEditorBlockData::find(quint64 id) const
 {
-    uniqueIds.removeOne(id);
+    for (const Match& match : matches) {
+        if (match.id == id) {
+            return &match;
+        }
+    }
+
+    return nullptr;
 }
@@ -0,0 +1,164 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "QCodeEditorParallelJob.hpp"
+
+// ranges smaller than this are not worth a thread
+static const int MinRangeSize = 1024;
+// ranges per thread, so that uneven ranges are balanced out
+static const int RangesPerThread = 4;
+
+class QCodeEditorParallelRunnable : public QRunnable
+{
+public:
+    QCodeEditorParallelRunnable(QCodeEditorParallelJob* job, int range)
+        : _job(job)
+        , _range(range)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        _job->tokenizeRange(_range);
+    }
+
+private:
+    QCodeEditorParallelJob* _job;
+    int _range;
+};
+
+QCodeEditorParallelJob::QCodeEditorParallelJob(const QSyntaxTokenizer& tokenizer, const QString& text)
+    : _tokenizer(tokenizer)
+    , _blocks(text.split(QChar::ParagraphSeparator))
+    , _fixedRanges(0)
+    , _wallTime(0)
+{
+    _results.resize(_blocks.size());
+}
+
+void QCodeEditorParallelJob::run(QThreadPool* pool)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const int maxRanges = qMax(1, pool->maxThreadCount() * RangesPerThread);
+    const int rangeCount = qBound(1, _blocks.size() / MinRangeSize, maxRanges);
+    const int rangeSize = (_blocks.size() + rangeCount - 1) / rangeCount;
+
+    _rangeStarts.clear();
+    for (int start = 0; start < _blocks.size(); start += rangeSize) {
+        _rangeStarts.push_back(start);
+    }
+
+    _rangeTimes.fill(0, _rangeStarts.size());
+
+    // the first range is tokenized on this thread, since it
+    // would otherwise just wait for the other ones.
+    for (int range = 1; range < _rangeStarts.size(); ++range) {
+        pool->start(new QCodeEditorParallelRunnable(this, range));
+    }
+
+    if (!_rangeStarts.isEmpty()) {
+        tokenizeRange(0);
+        _finished.acquire(_rangeStarts.size());
+    }
+
+    // every range depends on the state left by the previous one
+    for (int range = 1; range < _rangeStarts.size(); ++range) {
+        fixRange(range);
+    }
+
+    _wallTime = timer.nsecsElapsed();
+}
+
+void QCodeEditorParallelJob::tokenizeRange(int range)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const int end = (range + 1 < _rangeStarts.size()) ? _rangeStarts.at(range + 1) : _blocks.size();
+    int state = -1;
+
+    for (int block = _rangeStarts.at(range); block < end; ++block) {
+        _results[block] = _tokenizer.tokenize(_blocks.at(block), state);
+        state = _results.at(block).state;
+    }
+
+    _rangeTimes[range] = timer.nsecsElapsed();
+    _finished.release();
+}
+
+void QCodeEditorParallelJob::fixRange(int range)
+{
+    const int first = _rangeStarts.at(range);
+    const int end = (range + 1 < _rangeStarts.size()) ? _rangeStarts.at(range + 1) : _blocks.size();
+    int state = _results.at(first - 1).state;
+
+    if (state == -1) {
+        return;
+    }
+
+    // as soon as a block leaves the speculative state, all
+    // following blocks of the range are correct already.
+    ++_fixedRanges;
+    for (int block = first; block < end; ++block) {
+        QSyntaxBlockResult result = _tokenizer.tokenize(_blocks.at(block), state);
+        const bool converged = result.state == _results.at(block).state;
+
+        state = result.state;
+        _results[block] = result;
+
+        if (converged) {
+            break;
+        }
+    }
+}
+
+const QVector<QSyntaxBlockResult>& QCodeEditorParallelJob::results() const
+{
+    return _results;
+}
+
+int QCodeEditorParallelJob::rangeCount() const
+{
+    return _rangeStarts.size();
+}
+
+int QCodeEditorParallelJob::fixedRanges() const
+{
+    return _fixedRanges;
+}
+
+qint64 QCodeEditorParallelJob::workTime() const
+{
+    qint64 total = 0;
+    for (qint64 time : _rangeTimes) {
+        total += time;
+    }
+
+    return total;
+}
+
+qint64 QCodeEditorParallelJob::wallTime() const
+{
+    return _wallTime;
+}
@@ -0,0 +1,100 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QCODEEDITOR_QCODEEDITORPARALLELJOB_H
+#define QCODEEDITOR_QCODEEDITORPARALLELJOB_H
+
+#include <QSemaphore>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <QCodeEditor/QSyntaxTokenizer.hpp>
+
+class QThreadPool;
+
+/**
+ * Tokenizes all blocks of a snapshot on several threads at once.
+ * @class QCodeEditorParallelJob
+ *
+ * The blocks are split into ranges which are tokenized independently,
+ * assuming that no multi-line rule is open at the start of a range.
+ * Afterwards, every range that was actually entered with an open rule is
+ * tokenized again, until its states match the speculative ones.
+ */
+class QCodeEditorParallelJob
+{
+public:
+    /**
+     * Creates a new job for the given snapshot.
+     * @param tokenizer Tokenizer holding the compiled rules.
+     * @param text Raw text of the document (blocks separated by U+2029).
+     */
+    QCodeEditorParallelJob(const QSyntaxTokenizer& tokenizer, const QString& text);
+
+    /**
+     * Tokenizes all blocks; returns once all ranges were fixed up.
+     * @param pool Thread pool to run the ranges on.
+     */
+    void run(QThreadPool* pool);
+
+    /**
+     * Tokenizes a single range speculatively; called on the worker threads.
+     * @param range Index of the range.
+     */
+    void tokenizeRange(int range);
+
+    /**
+     * @return The results of all blocks.
+     */
+    const QVector<QSyntaxBlockResult>& results() const;
+
+    /**
+     * @return Amount of ranges that were tokenized in parallel.
+     */
+    int rangeCount() const;
+
+    /**
+     * @return Amount of ranges that were tokenized again.
+     */
+    int fixedRanges() const;
+
+    /**
+     * @return Summed up time the ranges took, in nanoseconds.
+     */
+    qint64 workTime() const;
+
+    /**
+     * @return Time run() took, in nanoseconds.
+     */
+    qint64 wallTime() const;
+
+private:
+    void fixRange(int range);
+
+    QSyntaxTokenizer _tokenizer;
+    QStringList _blocks;
+    QVector<QSyntaxBlockResult> _results;
+    QVector<int> _rangeStarts;
+    QVector<qint64> _rangeTimes;
+    QSemaphore _finished;
+    int _fixedRanges;
+    qint64 _wallTime;
+};
+
+#endif
@@ -0,0 +1,446 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QElapsedTimer>
+#include <QTextBlock>
+#include <QTextDocument>
+
+#include <QCodeEditor/QCodeEditorWordProvider.hpp>
+
+#include <algorithm>
+
+// marks a block whose words are read again once all changes are applied;
+// the ids of words are never negative.
+static const int DirtyBlock = -1;
+
+/**
+ * Identifier that starts with the word to complete.
+ */
+struct WordCandidate
+{
+    int references;
+    QString text;
+};
+
+// orders more frequent words first, equally frequent ones alphabetically
+static bool betterWord(const WordCandidate& a, const WordCandidate& b)
+{
+    return a.references > b.references || (a.references == b.references && a.text < b.text);
+}
+
+/**
+ * Identifier of the index, ordered by its text.
+ */
+struct SortedWord
+{
+    QString text;
+    int id;
+};
+
+// same order as the keywords of QCodeEditorCompletionModel
+static bool lessWord(const QString& a, const QString& b)
+{
+    const int order = QString::compare(a, b, Qt::CaseInsensitive);
+    return order < 0 || (order == 0 && a < b);
+}
+
+static bool lessSortedWord(const SortedWord& a, const SortedWord& b)
+{
+    return lessWord(a.text, b.text);
+}
+
+static int comparePrefix(const QString& word, const QString& prefix)
+{
+    return QStringRef::compare(word.leftRef(prefix.size()), prefix, Qt::CaseInsensitive);
+}
+
+static const QVector<int>& dirtyMarker()
+{
+    static const QVector<int> marker(1, DirtyBlock);
+    return marker;
+}
+
+static bool isDirty(const QVector<int>& ids)
+{
+    return ids.size() == 1 && ids.at(0) == DirtyBlock;
+}
+
+static bool isWordStart(QChar c)
+{
+    return c.isLetter() || c == QLatin1Char('_');
+}
+
+static bool isWordPart(QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+QCodeEditorWordProvider::QCodeEditorWordProvider(QTextDocument* document, QCodeEditorChangeTracker* tracker,
+                                                 QObject* parent)
+    : QCodeEditorCompletionProvider(parent)
+    , _document(document)
+    , _tracker(tracker)
+    , _revision(0)
+    , _updateTime(0)
+    , _minimumLength(3)
+    , _maxResults(50)
+    , _rebuilding(false)
+{
+    rebuild();
+
+    connect(tracker, SIGNAL(onChanged(QVector<QCodeEditorChange>,quint64)),
+            this, SLOT(update(QVector<QCodeEditorChange>,quint64)));
+}
+
+int QCodeEditorWordProvider::minimumLength() const
+{
+    return _minimumLength;
+}
+
+void QCodeEditorWordProvider::setMinimumLength(int length)
+{
+    if (length != _minimumLength) {
+        _minimumLength = qMax(1, length);
+        rebuild();
+    }
+}
+
+int QCodeEditorWordProvider::maxResults() const
+{
+    return _maxResults;
+}
+
+void QCodeEditorWordProvider::setMaxResults(int count)
+{
+    _maxResults = qMax(1, count);
+}
+
+int QCodeEditorWordProvider::wordCount() const
+{
+    return _ids.size();
+}
+
+int QCodeEditorWordProvider::references(const QString& word) const
+{
+    const int id = _ids.value(word, -1);
+    return id == -1 ? 0 : _words.at(id).references;
+}
+
+qint64 QCodeEditorWordProvider::updateTime() const
+{
+    return _updateTime;
+}
+
+qint64 QCodeEditorWordProvider::memoryUsage() const
+{
+    qint64 size = _words.capacity() * sizeof(Word) + _freeIds.capacity() * sizeof(int);
+
+    // the hash shares the strings of the words
+    size += _sorted.capacity() * sizeof(int);
+    size += _ids.capacity() * sizeof(void*) + _ids.size() * (sizeof(QString) + sizeof(int) + 2 * sizeof(void*));
+    for (const Word& word : _words) {
+        size += sizeof(QArrayData) + word.text.capacity() * sizeof(QChar);
+    }
+
+    // blocks without identifiers share the empty vector
+    size += _blocks.capacity() * sizeof(QVector<int>);
+    for (const QVector<int>& ids : _blocks) {
+        if (!ids.isEmpty()) {
+            size += sizeof(QArrayData) + ids.capacity() * sizeof(int);
+        }
+    }
+
+    return size;
+}
+
+void QCodeEditorWordProvider::rebuild()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    _ids.clear();
+    _words.clear();
+    _freeIds.clear();
+    _sorted.clear();
+    _blocks.clear();
+    _blocks.resize(_document->blockCount());
+
+    // sorts all words at once instead of inserting them one by one
+    _rebuilding = true;
+    for (QTextBlock block = _document->begin(); block.isValid(); block = block.next()) {
+        addBlock(block.blockNumber(), block.text());
+    }
+    _rebuilding = false;
+
+    QVector<SortedWord> sorted;
+    sorted.reserve(_words.size());
+    for (int i = 0; i < _words.size(); ++i) {
+        SortedWord word = { _words.at(i).text, i };
+        sorted.push_back(word);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), lessSortedWord);
+    _sorted.reserve(sorted.size());
+    for (const SortedWord& word : sorted) {
+        _sorted.push_back(word.id);
+    }
+
+    _revision = _tracker->revision();
+    _updateTime = timer.nsecsElapsed();
+}
+
+void QCodeEditorWordProvider::request(const QCodeEditorCompletionRequest& request)
+{
+    // applies the changes of the last keystrokes first
+    if (!_tracker->pendingChanges().isEmpty()) {
+        _tracker->flush();
+    }
+
+    // the heap keeps the worst of the best words on top
+    QVector<WordCandidate> heap;
+    heap.reserve(_maxResults + 1);
+
+    // only the words within the range start with the prefix
+    int first, last;
+    findRange(request.prefix, &first, &last);
+
+    for (int i = first; i < last; ++i) {
+        const Word& word = _words.at(_sorted.at(i));
+        if (word.text == request.prefix) {
+            continue;
+        }
+
+        WordCandidate candidate = { word.references, word.text };
+        if (heap.size() < _maxResults) {
+            heap.push_back(candidate);
+            std::push_heap(heap.begin(), heap.end(), betterWord);
+        } else if (betterWord(candidate, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), betterWord);
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end(), betterWord);
+        }
+    }
+
+    std::sort_heap(heap.begin(), heap.end(), betterWord);
+
+    QStringList completions;
+    for (const WordCandidate& candidate : heap) {
+        completions.push_back(candidate.text);
+    }
+
+    deliver(request.id, completions);
+}
+
+void QCodeEditorWordProvider::update(const QVector<QCodeEditorChange>& changes, quint64 revision)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // the changes are applied in order, therefore the blocks of a change
+    // refer to the document after all previous changes. The words of the
+    // replaced blocks are released right away; the new blocks are marked
+    // and read once all changes are applied, from the current document.
+    // The marks move along with the blocks, and the bounds of the marked
+    // blocks are kept, so that each change only costs its own blocks.
+    int lowest = _blocks.size();
+    int highest = -1;
+    for (const QCodeEditorChange& change : changes) {
+        // changes made before the index was built are part of it already
+        if (change.revision <= _revision) {
+            continue;
+        }
+
+        const int first = change.firstBlock;
+        const int removed = change.lastBlock - change.blockDelta - first + 1;
+        const int added = change.lastBlock - first + 1;
+        if (first < 0 || removed < 1 || first + removed > _blocks.size()) {
+            rebuild();
+            return;
+        }
+
+        for (int block = first; block < first + removed; ++block) {
+            removeBlock(block);
+        }
+
+        if (change.blockDelta > 0) {
+            _blocks.insert(first + removed, change.blockDelta, QVector<int>());
+        } else if (change.blockDelta < 0) {
+            _blocks.remove(first + added, -change.blockDelta);
+        }
+
+        for (int block = first; block < first + added; ++block) {
+            _blocks[block] = dirtyMarker();
+        }
+
+        // marks behind the replaced blocks moved by the delta
+        const int oldLast = first + removed - 1;
+        if (highest > oldLast) {
+            highest += change.blockDelta;
+        }
+
+        lowest = qMin(lowest, first);
+        highest = qMax(highest, first + added - 1);
+    }
+
+    // a change the tracker could not describe leaves the index out of sync
+    if (_blocks.size() != _document->blockCount()) {
+        rebuild();
+        return;
+    }
+
+    QTextBlock block = _document->findBlockByNumber(lowest);
+    for (int number = lowest; number <= highest && block.isValid(); ++number) {
+        if (isDirty(_blocks.at(number))) {
+            _blocks[number] = QVector<int>();
+            addBlock(number, block.text());
+        }
+
+        block = block.next();
+    }
+
+    _revision = revision;
+    _updateTime = timer.nsecsElapsed();
+}
+
+void QCodeEditorWordProvider::addBlock(int block, const QString& text)
+{
+    QVector<int>& ids = _blocks[block];
+    const int size = text.size();
+    int pos = 0;
+
+    while (pos < size) {
+        if (!isWordStart(text.at(pos))) {
+            // skips the rest of numbers, such as the 'f' of '1.0f'
+            while (pos < size && isWordPart(text.at(pos))) {
+                ++pos;
+            }
+
+            ++pos;
+            continue;
+        }
+
+        const int start = pos;
+        while (pos < size && isWordPart(text.at(pos))) {
+            ++pos;
+        }
+
+        if (pos - start >= _minimumLength) {
+            ids.push_back(acquire(text.constData() + start, pos - start));
+        }
+    }
+
+    ids.squeeze();
+}
+
+void QCodeEditorWordProvider::removeBlock(int block)
+{
+    // marked blocks do not hold any words yet
+    if (isDirty(_blocks.at(block))) {
+        _blocks[block] = QVector<int>();
+        return;
+    }
+
+    for (int id : _blocks.at(block)) {
+        release(id);
+    }
+
+    _blocks[block] = QVector<int>();
+}
+
+int QCodeEditorWordProvider::acquire(const QChar* text, int length)
+{
+    // looks the word up without copying it
+    const int id = _ids.value(QString::fromRawData(text, length), -1);
+    if (id != -1) {
+        ++_words[id].references;
+        return id;
+    }
+
+    Word word = { QString(text, length), 1 };
+    int newId;
+    if (_freeIds.isEmpty()) {
+        newId = _words.size();
+        _words.push_back(word);
+    } else {
+        newId = _freeIds.takeLast();
+        _words[newId] = word;
+    }
+
+    _ids.insert(word.text, newId);
+    if (!_rebuilding) {
+        _sorted.insert(lowerBound(word.text), newId);
+    }
+
+    return newId;
+}
+
+void QCodeEditorWordProvider::release(int id)
+{
+    Word& word = _words[id];
+    if (--word.references == 0) {
+        _ids.remove(word.text);
+        _sorted.remove(lowerBound(word.text));
+        word.text = QString();
+        _freeIds.push_back(id);
+    }
+}
+
+int QCodeEditorWordProvider::lowerBound(const QString& word) const
+{
+    int low = 0;
+    int high = _sorted.size();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (lessWord(_words.at(_sorted.at(middle)).text, word)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+void QCodeEditorWordProvider::findRange(const QString& prefix, int* first, int* last) const
+{
+    // the words starting with the prefix are contiguous
+    int low = 0;
+    int high = _sorted.size();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (comparePrefix(_words.at(_sorted.at(middle)).text, prefix) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *first = low;
+    high = _sorted.size();
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (comparePrefix(_words.at(_sorted.at(middle)).text, prefix) <= 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *last = low;
+}
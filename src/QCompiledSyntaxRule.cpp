@@ -0,0 +1,474 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCodeEditor/QCompiledSyntaxRule.hpp>
+
+static bool compileRegex(const QString& pattern, QRegularExpression& regex, QString& error, int limit)
+{
+    // PCRE only allows lowering its match limit from within the pattern
+    const QString prefix = (limit > 0) ? QString("(*LIMIT_MATCH=%0)").arg(limit) : QString();
+    regex.setPattern(prefix + pattern);
+
+    if (!regex.isValid()) {
+        if (error.isEmpty()) {
+            QString msg("Invalid regex '%0' at offset %1: %2");
+            const int offset = qMax(0, regex.patternErrorOffset() - prefix.length());
+            error = msg.arg(pattern).arg(offset).arg(regex.errorString());
+        }
+        return false;
+    }
+
+    // compiles (and JITs, if available) the pattern right away instead
+    // of doing it on first usage while highlighting.
+    regex.optimize();
+    return true;
+}
+
+// Determines whether all keywords stand for themselves. Rule files used to
+// have their keywords joined into a regex, so some of them escape characters
+// or use regex syntax; those are still matched as a regex.
+static bool plainKeywords(const QStringList& keywords)
+{
+    static const QRegularExpression syntax("[\\\\^$.|?*+()\\[\\]{}]");
+    for (const QString& keyword : keywords) {
+        if (keyword.contains(syntax)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Used by keyword rules, which do not have a regex.
+static const QRegularExpression& neverMatching()
+{
+    static const QRegularExpression regex("(?!)");
+    return regex;
+}
+
+static int skipClass(const QString& pattern, int i)
+{
+    // a closing bracket right after the opening one is a literal
+    ++i;
+    if (i < pattern.size() && pattern.at(i) == '^') {
+        ++i;
+    }
+
+    if (i < pattern.size() && pattern.at(i) == ']') {
+        ++i;
+    }
+
+    while (i < pattern.size() && pattern.at(i) != ']') {
+        if (pattern.midRef(i, 2) == QLatin1String("[:")) {
+            // POSIX classes like [:alpha:]
+            const int end = pattern.indexOf(QLatin1String(":]"), i + 2);
+            i = (end == -1) ? i + 1 : end + 2;
+        } else {
+            i += (pattern.at(i) == '\\') ? 2 : 1;
+        }
+    }
+
+    return i + 1;
+}
+
+static int skipGroup(const QString& pattern, int i)
+{
+    int depth = 0;
+    while (i < pattern.size()) {
+        const QChar c = pattern.at(i);
+        if (c == '\\') {
+            i += 2;
+            continue;
+        } else if (c == '[') {
+            i = skipClass(pattern, i);
+            continue;
+        } else if (c == '(') {
+            ++depth;
+        } else if (c == ')' && --depth == 0) {
+            return i + 1;
+        }
+
+        ++i;
+    }
+
+    return i;
+}
+
+static bool isHexDigit(QChar c)
+{
+    return c.isDigit() || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// Skips an escape sequence including its operand, e.g. the digits of \x41
+// or \012 and the property of \pL, so that they are not taken as literals.
+static int skipEscape(const QString& pattern, int i)
+{
+    const int n = pattern.size();
+    const QChar e = (i + 1 < n) ? pattern.at(i + 1) : QChar();
+    int next = i + 2;
+
+    // \x{..}, \p{..}, \o{..}, \g{..}, \k<..>, \k'..', \cX and friends
+    if (e == 'c') {
+        return qMin(n, i + 3);
+    } else if (e == 'Q') {
+        // quoted sequences are not examined at all
+        const int end = pattern.indexOf(QLatin1String("\\E"), next);
+        return (end == -1) ? n : end + 2;
+    } else if (e.isLetter() && next < n) {
+        const QChar open = pattern.at(next);
+        const QChar close = (open == '{') ? QChar('}') : (open == '<') ? QChar('>') : QChar('\'');
+        if (open == '{' || ((e == 'k' || e == 'g') && (open == '<' || open == '\''))) {
+            const int end = pattern.indexOf(close, i + 3);
+            return (end == -1) ? n : end + 1;
+        } else if (e == 'p' || e == 'P') {
+            return next + 1;
+        } else if (e == 'x') {
+            while (next < n && next < i + 4 && isHexDigit(pattern.at(next))) {
+                ++next;
+            }
+        } else if (e == 'g') {
+            // relative and absolute references without braces, e.g. \g-1
+            if (pattern.at(next) == '+' || pattern.at(next) == '-') {
+                ++next;
+            }
+
+            while (next < n && pattern.at(next).isDigit()) {
+                ++next;
+            }
+        }
+    } else if (e.isDigit()) {
+        // octal codes and back references
+        while (next < n && next < i + 4 && pattern.at(next).isDigit()) {
+            ++next;
+        }
+    }
+
+    return next;
+}
+
+// Derives the longest run of literal characters that every match of a
+// pattern without top-level alternation contains.
+static QString longestLiteral(const QString& pattern)
+{
+    QString best;
+    QString run;
+    int i = 0;
+
+    while (i < pattern.size()) {
+        const QChar c = pattern.at(i);
+        bool literal = false;
+        int next = i + 1;
+
+        if (c == '\\') {
+            // escaped punctuation stands for itself
+            next = skipEscape(pattern, i);
+            literal = (next == i + 2 && i + 1 < pattern.size() && !pattern.at(i + 1).isLetterOrNumber());
+        } else if (c == '[') {
+            next = skipClass(pattern, i);
+        } else if (c == '(') {
+            next = skipGroup(pattern, i);
+        } else if (c == '{') {
+            // braces that do not form a quantifier might still be one
+            // for newer PCRE versions (e.g. {,3}), so they are left out.
+            const int close = pattern.indexOf('}', i);
+            next = (close == -1) ? pattern.size() : close + 1;
+        } else if (c == '*' || c == '+' || c == '?' || c == ')') {
+            return QString();
+        } else {
+            literal = (c != '.' && c != '^' && c != '$');
+        }
+
+        // the quantifier following the token
+        bool optional = false;
+        bool repeated = false;
+        int end = next;
+        if (end < pattern.size()) {
+            const QChar q = pattern.at(end);
+            if (q == '?' || q == '*') {
+                optional = true;
+                ++end;
+            } else if (q == '+') {
+                repeated = true;
+                ++end;
+            } else if (q == '{') {
+                static const QRegularExpression quantifier("\\G\\{(\\d+)(,\\d*)?\\}");
+                QRegularExpressionMatch match = quantifier.match(pattern, end);
+                if (match.hasMatch()) {
+                    const int min = match.captured(1).toInt();
+                    optional = (min == 0);
+                    repeated = (min != 1 || !match.captured(2).isEmpty());
+                    end = match.capturedEnd();
+                }
+            }
+
+            // lazy and possessive quantifiers
+            if (end != next && end < pattern.size() && (pattern.at(end) == '?' || pattern.at(end) == '+')) {
+                ++end;
+            }
+        }
+
+        if (literal && !optional) {
+            run.append(c == '\\' ? pattern.at(i + 1) : c);
+        }
+
+        if (!literal || optional || repeated) {
+            if (run.size() > best.size()) {
+                best = run;
+            }
+
+            run.clear();
+        }
+
+        i = end;
+    }
+
+    return (run.size() > best.size()) ? run : best;
+}
+
+// Derives the literals of which every match of the pattern contains at
+// least one; empty if there is a branch without literals.
+static QStringList deriveLiterals(const QString& pattern)
+{
+    // options and verbs might make the literals case-insensitive or
+    // change the meaning of whitespace within the pattern.
+    static const QRegularExpression options("\\(\\?[a-zA-Z^-]*[ixX]|^\\(\\*");
+    if (pattern.isEmpty() || pattern.contains(options)) {
+        return QStringList();
+    }
+
+    QStringList branches;
+    int start = 0;
+    int i = 0;
+    while (i < pattern.size()) {
+        const QChar c = pattern.at(i);
+        if (c == '\\') {
+            i = skipEscape(pattern, i);
+        } else if (c == '[') {
+            i = skipClass(pattern, i);
+        } else if (c == '(') {
+            i = skipGroup(pattern, i);
+        } else {
+            if (c == '|') {
+                branches.push_back(pattern.mid(start, i - start));
+                start = i + 1;
+            }
+
+            ++i;
+        }
+    }
+
+    branches.push_back(pattern.mid(start));
+
+    QStringList literals;
+    for (const QString& branch : branches) {
+        const QString literal = longestLiteral(branch);
+        if (literal.isEmpty()) {
+            return QStringList();
+        } else if (!literals.contains(literal)) {
+            literals.push_back(literal);
+        }
+    }
+
+    return literals;
+}
+
+QCompiledSyntaxRule::QCompiledSyntaxRule()
+    : _matchLimit(0)
+    , _isGlobal(true)
+    , _hasId(false)
+    , _isMultiLine(false)
+    , _isExclusive(false)
+    , _hasKeywords(false)
+{
+}
+
+QCompiledSyntaxRule::QCompiledSyntaxRule(const QSyntaxRule& rule, int matchLimit)
+    : _pattern(rule.regex())
+    , _matchLimit(qMax(0, matchLimit))
+    , _isGlobal(rule.isGlobal())
+    , _hasId(!rule.id().isEmpty())
+    , _isMultiLine(!rule.closingRegex().isEmpty())
+    , _isExclusive(rule.isExclusive())
+    , _hasKeywords(!rule.keywords().isEmpty() && plainKeywords(rule.keywords()))
+{
+    if (_hasKeywords) {
+        // the keyword alternation is never compiled; it would backtrack
+        // through every single keyword at every position.
+        _keywords = QSyntaxKeywordMatcher(
+            rule.keywords(),
+            rule.keywordsAtLineBegin(),
+            rule.keywordCaseSensitivity());
+        _regex = neverMatching();
+    } else if (compileRegex(rule.regex(), _regex, _error, _matchLimit)) {
+        _literals = deriveLiterals(rule.regex());
+        for (const QString& literal : _literals) {
+            _literalMatchers.push_back(QStringMatcher(literal));
+        }
+    }
+
+    // the opening regex is usually the main regex, which is compiled already.
+    if (rule.openingRegex().isEmpty() || _hasKeywords || rule.openingRegex() == rule.regex()) {
+        _startReg = _regex;
+    } else {
+        compileRegex(rule.openingRegex(), _startReg, _error, _matchLimit);
+    }
+
+    if (_isMultiLine) {
+        compileRegex(rule.closingRegex(), _endReg, _error, _matchLimit);
+    }
+
+    // resolves the capture groups once, instead of looking up names per match
+    if (!_hasKeywords && _regex.isValid()) {
+        const QStringList names = _regex.namedCaptureGroups();
+        for (const QSyntaxGroup& group : rule.groups()) {
+            const int capture = group.name().isEmpty() ? group.index() : names.indexOf(group.name());
+            if (capture <= 0 || capture > _regex.captureCount()) {
+                if (_error.isEmpty()) {
+                    QString name = group.name().isEmpty() ? QString::number(group.index()) : group.name();
+                    _error = QString("Capture group '%0' does not exist in regex '%1'").arg(name, rule.regex());
+                }
+            }
+
+            _groupCaptures.push_back(capture);
+        }
+    }
+}
+
+const QRegularExpression& QCompiledSyntaxRule::openingRegex() const
+{
+    return _startReg;
+}
+
+const QString& QCompiledSyntaxRule::pattern() const
+{
+    return _pattern;
+}
+
+int QCompiledSyntaxRule::matchLimit() const
+{
+    return _matchLimit;
+}
+
+const QRegularExpression& QCompiledSyntaxRule::regex() const
+{
+    return _regex;
+}
+
+const QSyntaxKeywordMatcher& QCompiledSyntaxRule::keywordMatcher() const
+{
+    return _keywords;
+}
+
+bool QCompiledSyntaxRule::hasKeywords() const
+{
+    return _hasKeywords;
+}
+
+int QCompiledSyntaxRule::indexIn(const QString& text, int offset, int* length) const
+{
+    QRegularExpressionMatch match;
+    return indexIn(text, offset, length, &match);
+}
+
+int QCompiledSyntaxRule::indexIn(const QString& text, int offset, int* length, QRegularExpressionMatch* match) const
+{
+    if (_hasKeywords) {
+        return _keywords.indexIn(text, offset, length);
+    }
+
+    *match = _regex.match(text, offset);
+    if (!match->hasMatch()) {
+        *length = 0;
+        return -1;
+    }
+
+    *length = match->capturedLength();
+    return match->capturedStart();
+}
+
+bool QCompiledSyntaxRule::hasGroups() const
+{
+    return !_groupCaptures.isEmpty();
+}
+
+const QVector<int>& QCompiledSyntaxRule::groupCaptures() const
+{
+    return _groupCaptures;
+}
+
+bool QCompiledSyntaxRule::hasPrefilter() const
+{
+    return !_literals.isEmpty();
+}
+
+const QStringList& QCompiledSyntaxRule::requiredLiterals() const
+{
+    return _literals;
+}
+
+bool QCompiledSyntaxRule::mayMatch(const QString& text) const
+{
+    if (_literals.isEmpty()) {
+        return true;
+    }
+
+    // single characters are searched with QString's vectorized search
+    for (int i = 0; i < _literals.size(); ++i) {
+        const QString& literal = _literals.at(i);
+        if (literal.size() == 1 ? text.contains(literal.at(0)) : _literalMatchers.at(i).indexIn(text) != -1) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const QRegularExpression& QCompiledSyntaxRule::closingRegex() const
+{
+    return _endReg;
+}
+
+bool QCompiledSyntaxRule::isGlobal() const
+{
+    return _isGlobal;
+}
+
+bool QCompiledSyntaxRule::hasId() const
+{
+    return _hasId;
+}
+
+bool QCompiledSyntaxRule::isMultiLine() const
+{
+    return _isMultiLine;
+}
+
+bool QCompiledSyntaxRule::isExclusive() const
+{
+    return _isExclusive;
+}
+
+bool QCompiledSyntaxRule::isValid() const
+{
+    return _error.isEmpty();
+}
+
+const QString& QCompiledSyntaxRule::errorString() const
+{
+    return _error;
+}
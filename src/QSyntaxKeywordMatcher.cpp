@@ -0,0 +1,192 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <QCodeEditor/QSyntaxKeywordMatcher.hpp>
+
+static bool isWordChar(QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+QSyntaxKeywordMatcher::QSyntaxKeywordMatcher()
+    : _lineBegin(false)
+    , _caseInsensitive(false)
+{
+}
+
+QSyntaxKeywordMatcher::QSyntaxKeywordMatcher(const QStringList& keywords, bool lineBegin, Qt::CaseSensitivity cs)
+    : _lineBegin(lineBegin)
+    , _caseInsensitive(cs == Qt::CaseInsensitive)
+{
+    QStringList words;
+    words.reserve(keywords.size());
+
+    for (const QString& keyword : keywords) {
+        if (keyword.isEmpty()) {
+            continue;
+        }
+
+        // folds every character on its own, so that the keyword has
+        // exactly as many characters as the text it is compared with.
+        QString word(keyword);
+        for (int i = 0; i < word.size(); ++i) {
+            word[i] = fold(word.at(i));
+        }
+
+        words.push_back(word);
+    }
+
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    if (words.isEmpty()) {
+        return;
+    }
+
+    // builds the trie breadth-first, so that the edges of every node are
+    // stored next to each other and sorted by their character.
+    struct Range {
+        int node;
+        int first;
+        int last;
+        int depth;
+    };
+
+    QVector<Range> queue;
+    _nodes.push_back(Node{0, 0, false});
+    queue.push_back(Range{0, 0, words.size(), 0});
+
+    for (int i = 0; i < queue.size(); ++i) {
+        const Range range = queue.at(i);
+        int first = range.first;
+
+        // the sorted range starts with the keyword ending at this node, if any
+        if (words.at(first).length() == range.depth) {
+            _nodes[range.node].terminal = true;
+            ++first;
+        }
+
+        _nodes[range.node].edges = _edges.size();
+        while (first < range.last) {
+            ushort ch = words.at(first).at(range.depth).unicode();
+            int last = first + 1;
+            while (last < range.last && words.at(last).at(range.depth).unicode() == ch) {
+                ++last;
+            }
+
+            _edges.push_back(Edge{ch, _nodes.size()});
+            queue.push_back(Range{_nodes.size(), first, last, range.depth + 1});
+            _nodes.push_back(Node{0, 0, false});
+            first = last;
+        }
+
+        _nodes[range.node].edgeCount = _edges.size() - _nodes[range.node].edges;
+    }
+}
+
+bool QSyntaxKeywordMatcher::isEmpty() const
+{
+    return _nodes.isEmpty();
+}
+
+int QSyntaxKeywordMatcher::indexIn(const QString& text, int offset, int* length) const
+{
+    *length = 0;
+    if (_nodes.isEmpty()) {
+        return -1;
+    }
+
+    const int size = text.size();
+    int pos = qMax(offset, 0);
+
+    if (_lineBegin) {
+        // only the first word in the line is a candidate
+        int first = 0;
+        while (first < size && text.at(first).isSpace()) {
+            ++first;
+        }
+
+        if (first < pos || first >= size) {
+            return -1;
+        }
+
+        *length = matchAt(text, first);
+        return (*length > 0) ? first : -1;
+    }
+
+    // keywords never start in the middle of a word
+    while (pos > 0 && pos < size && isWordChar(text.at(pos - 1)) && isWordChar(text.at(pos))) {
+        ++pos;
+    }
+
+    while (pos < size) {
+        const int matched = matchAt(text, pos);
+        if (matched > 0) {
+            *length = matched;
+            return pos;
+        }
+
+        if (isWordChar(text.at(pos))) {
+            // skips the rest of the word
+            while (pos < size && isWordChar(text.at(pos))) {
+                ++pos;
+            }
+        } else {
+            ++pos;
+        }
+    }
+
+    return -1;
+}
+
+int QSyntaxKeywordMatcher::matchAt(const QString& text, int pos) const
+{
+    const int size = text.size();
+    int node = 0;
+    int end = -1;
+
+    for (int i = pos; i < size; ++i) {
+        const ushort ch = fold(text.at(i)).unicode();
+        const Node& current = _nodes.at(node);
+        const Edge* first = _edges.constData() + current.edges;
+        const Edge* last = first + current.edgeCount;
+        const Edge* edge = std::lower_bound(first, last, ch, [](const Edge& e, ushort c) {
+            return e.ch < c;
+        });
+
+        if (edge == last || edge->ch != ch) {
+            break;
+        }
+
+        node = edge->node;
+        if (_nodes.at(node).terminal) {
+            // keywords ending with a word character need a word boundary
+            if (!isWordChar(text.at(i)) || i + 1 == size || !isWordChar(text.at(i + 1))) {
+                end = i + 1;
+            }
+        }
+    }
+
+    return (end == -1) ? 0 : end - pos;
+}
+
+QChar QSyntaxKeywordMatcher::fold(QChar c) const
+{
+    return _caseInsensitive ? c.toCaseFolded() : c;
+}
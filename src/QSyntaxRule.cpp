@@ -22,6 +22,70 @@
 #include <QCodeEditor/QSyntaxRule.hpp>
 #include "XmlHelper.hpp"
 
+QSyntaxGroup::QSyntaxGroup()
+    : _index(0)
+    , _backColor(Qt::transparent)
+    , _foreColor(Qt::transparent)
+    , _useFont(false)
+{
+}
+
+const QString& QSyntaxGroup::name() const
+{
+    return _name;
+}
+
+int QSyntaxGroup::index() const
+{
+    return _index;
+}
+
+const QFont& QSyntaxGroup::font() const
+{
+    return _font;
+}
+
+const QColor& QSyntaxGroup::backColor() const
+{
+    return _backColor;
+}
+
+const QColor& QSyntaxGroup::foreColor() const
+{
+    return _foreColor;
+}
+
+bool QSyntaxGroup::useFont() const
+{
+    return _useFont;
+}
+
+void QSyntaxGroup::setName(const QString& name)
+{
+    _name = name;
+}
+
+void QSyntaxGroup::setIndex(int index)
+{
+    _index = index;
+}
+
+void QSyntaxGroup::setFont(const QFont& font)
+{
+    _font = font;
+    _useFont = true;
+}
+
+void QSyntaxGroup::setBackColor(const QColor& backColor)
+{
+    _backColor = backColor;
+}
+
+void QSyntaxGroup::setForeColor(const QColor& foreColor)
+{
+    _foreColor = foreColor;
+}
+
 QSyntaxRule::QSyntaxRule()
     : _regex("")
     , _backColor(Qt::transparent)
@@ -29,7 +93,10 @@ QSyntaxRule::QSyntaxRule()
     , _id("")
     , _startReg("")
     , _endReg("")
+    , _keywordCase(Qt::CaseSensitive)
+    , _keywordsAtLineBegin(false)
     , _isGlobal(true)
+    , _isExclusive(false)
     , _useFont(false)
 {
 }
@@ -69,25 +136,60 @@ const QString& QSyntaxRule::closingRegex() const
     return _endReg;
 }
 
+const QStringList& QSyntaxRule::keywords() const
+{
+    return _keywords;
+}
+
+bool QSyntaxRule::keywordsAtLineBegin() const
+{
+    return _keywordsAtLineBegin;
+}
+
+Qt::CaseSensitivity QSyntaxRule::keywordCaseSensitivity() const
+{
+    return _keywordCase;
+}
+
 bool QSyntaxRule::isGlobal() const
 {
     return _isGlobal;
 }
 
+bool QSyntaxRule::isExclusive() const
+{
+    return _isExclusive;
+}
+
 bool QSyntaxRule::useFont() const
 {
     return _useFont;
 }
 
+const QList<QSyntaxGroup>& QSyntaxRule::groups() const
+{
+    return _groups;
+}
+
 void QSyntaxRule::setRegex(const QString& regex)
 {
     _regex = regex;
+    _keywords.clear();
 }
 
-void QSyntaxRule::setKeywords(const QStringList& keywords, bool lineBegin)
+void QSyntaxRule::setKeywords(const QStringList& keywords, bool lineBegin, Qt::CaseSensitivity cs)
 {
+    _keywords = keywords;
+    _keywordsAtLineBegin = lineBegin;
+    _keywordCase = cs;
     _regex.clear();
 
+    // the regex is not used for highlighting anymore, but still
+    // identifies the rule and describes what it matches.
+    if (cs == Qt::CaseInsensitive) {
+        _regex.append("(?i)");
+    }
+
     // appends a regex that requires the given keywords either to be at the
     // start of the line or to be the first non-whitespace on the line.
     if (lineBegin) {
@@ -125,6 +227,7 @@ void QSyntaxRule::setOpeningRegex(const QString& regex)
 {
     _startReg = regex;
     _regex = regex;
+    _keywords.clear();
 }
 
 void QSyntaxRule::setClosingRegex(const QString& regex)
@@ -137,6 +240,21 @@ void QSyntaxRule::setGlobal(bool global)
     _isGlobal = global;
 }
 
+void QSyntaxRule::setExclusive(bool exclusive)
+{
+    _isExclusive = exclusive;
+}
+
+void QSyntaxRule::addGroup(const QSyntaxGroup& group)
+{
+    _groups.push_back(group);
+}
+
+void QSyntaxRule::setGroups(const QList<QSyntaxGroup>& groups)
+{
+    _groups = groups;
+}
+
 QList<QSyntaxRule> QSyntaxRules::loadFromFile(const QString& path, const QCodeEditorDesign& design)
 {
     QList<QSyntaxRule> rules;
@@ -164,20 +282,16 @@ QList<QSyntaxRule> QSyntaxRules::loadFromFile(const QString& path, const QCodeEd
 
         QSyntaxRule rule;
         QXmlStreamAttributes a = xmlReader.attributes();
-        if (!a.isEmpty()) {
-            auto first = a.at(0);
-            if (first.name() == "id") {
-                rule.setId(first.value().toString());
-            } else if (first.name() == "global") {
-                rule.setGlobal((first.value().toString() == "true") ? true : false);
-            } if (a.size() > 1) {
-                auto second = a.at(1);
-                if (second.name() == "id") {
-                    rule.setId(second.value().toString());
-                } else if (second.name() == "global") {
-                    rule.setGlobal((second.value().toString() == "true") ? true : false);
-                }
-            }
+        if (a.hasAttribute("id")) {
+            rule.setId(a.value("id").toString());
+        }
+
+        if (a.hasAttribute("global")) {
+            rule.setGlobal(a.value("global") == "true");
+        }
+
+        if (a.hasAttribute("exclusive")) {
+            rule.setExclusive(a.value("exclusive") == "true");
         }
 
         while (!(xmlReader.isEndElement() && xmlReader.name() == "rule")) {
@@ -192,21 +306,42 @@ QList<QSyntaxRule> QSyntaxRules::loadFromFile(const QString& path, const QCodeEd
             } else if (name == "closeregex") {
                 rule.setClosingRegex(xmlReader.readElementText());
             } else if (name == "keywords") {
-                bool firstWord = false;
                 auto attr = xmlReader.attributes();
-                if (!attr.isEmpty() && attr.at(0).name() == "start") {
-                    if (attr.at(0).value() == "true") {
-                        firstWord = true;
-                    }
-                }
+                bool firstWord = (attr.value("start") == "true");
+                auto cs = (attr.value("casesensitive") == "false") ? Qt::CaseInsensitive : Qt::CaseSensitive;
 
-                rule.setKeywords(XmlHelper::readKeywords(xmlReader), firstWord);
+                rule.setKeywords(XmlHelper::readKeywords(xmlReader), firstWord, cs);
             } else if (name == "backcolor") {
                 rule.setBackColor(XmlHelper::readColor(xmlReader));
             } else if (name == "forecolor") {
                 rule.setForeColor(XmlHelper::readColor(xmlReader));
             } else if (name == "font") {
                 rule.setFont(XmlHelper::readFont(xmlReader, design.editorFont()));
+            } else if (name == "group") {
+                QSyntaxGroup group;
+                auto attr = xmlReader.attributes();
+                if (attr.hasAttribute("name")) {
+                    group.setName(attr.value("name").toString());
+                } else {
+                    group.setIndex(attr.value("index").toInt());
+                }
+
+                while (xmlReader.readNextStartElement()) {
+                    auto property = xmlReader.name().toString().toLower();
+                    if (property == "backcolor") {
+                        group.setBackColor(XmlHelper::readColor(xmlReader));
+                    } else if (property == "forecolor") {
+                        group.setForeColor(XmlHelper::readColor(xmlReader));
+                    } else if (property == "font") {
+                        group.setFont(XmlHelper::readFont(xmlReader, design.editorFont()));
+                    } else {
+                        QString msg("Element '%0' is unknown.");
+                        qDebug(msg.arg(property).toStdString().c_str());
+                        xmlReader.skipCurrentElement();
+                    }
+                }
+
+                rule.addGroup(group);
             } else {
                 QString msg("Element '%0' is unknown.");
                 qDebug(msg.arg(name).toStdString().c_str());
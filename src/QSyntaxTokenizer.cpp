@@ -0,0 +1,492 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QAtomicInteger>
+#include <QScopedArrayPointer>
+#include <QStringList>
+
+#include <QCodeEditor/QSyntaxTokenizer.hpp>
+
+#include <algorithm>
+
+// shared by all copies of a tokenizer, including the ones on worker threads.
+// The profiles have an additional slot for the merged rules.
+struct QSyntaxTokenizerCounters
+{
+    explicit QSyntaxTokenizerCounters(int size)
+        : filtered(new QAtomicInteger<quint64>[size])
+        , skipped(new QAtomicInteger<quint64>[size])
+        , invocations(new QAtomicInteger<quint64>[size + 1])
+        , matches(new QAtomicInteger<quint64>[size + 1])
+        , bytes(new QAtomicInteger<quint64>[size + 1])
+        , time(new QAtomicInteger<quint64>[size + 1])
+    {
+    }
+
+    QScopedArrayPointer<QAtomicInteger<quint64>> filtered;
+    QScopedArrayPointer<QAtomicInteger<quint64>> skipped;
+    QScopedArrayPointer<QAtomicInteger<quint64>> invocations;
+    QScopedArrayPointer<QAtomicInteger<quint64>> matches;
+    QScopedArrayPointer<QAtomicInteger<quint64>> bytes;
+    QScopedArrayPointer<QAtomicInteger<quint64>> time;
+};
+
+static int countMatches(const QVector<QSyntaxSpan>& spans, int first)
+{
+    int count = 0;
+    for (int i = first; i < spans.size(); ++i) {
+        if (spans.at(i).group == 0) {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+static bool lessRule(const QSyntaxSpan& a, const QSyntaxSpan& b)
+{
+    return a.rule < b.rule;
+}
+
+QSyntaxTokenizer::QSyntaxTokenizer(const QVector<QCompiledSyntaxRule>& rules, bool combine)
+    : _rules(rules)
+    , _counters(new QSyntaxTokenizerCounters(rules.size()))
+{
+    for (int i = 0; i < _rules.size(); ++i) {
+        if (_rules.at(i).isExclusive()) {
+            _exclusiveRules.push_back(i);
+        }
+    }
+
+    if (combine) {
+        combineRules();
+    }
+}
+
+void QSyntaxTokenizer::combineRules()
+{
+    // group numbers are shifted within the alternation; patterns referring
+    // to their groups would match something else. Subroutine calls and
+    // conditions would refer to the groups of other rules, and recursion
+    // would recurse into the whole alternation.
+    static const QRegularExpression references(
+        "\\\\(?:[1-9]|g|k)|\\(\\?(?:P?<[A-Za-z_]|'|\\||[+-]?\\d|R|&|P[>=]|\\()");
+
+    QStringList alternatives;
+    int group = 1;
+
+    // later rules are tried first, since their formats win anyway
+    for (int i = _rules.size() - 1; i >= 0; --i) {
+        const auto& rule = _rules.at(i);
+        if (!rule.isValid() || !rule.isGlobal() || rule.isMultiLine() || rule.hasKeywords()
+                || rule.hasGroups() || rule.isExclusive()) {
+            continue;
+        }
+
+        const QString pattern = rule.pattern();
+        if (pattern.contains(references)) {
+            continue;
+        }
+
+        alternatives.push_back("(" + pattern + ")");
+        _combinedRules.push_back(i);
+        _combinedGroups.push_back(group);
+        group += 1 + rule.regex().captureCount();
+    }
+
+    // a single rule is scanned just as fast on its own
+    if (alternatives.size() > 1) {
+        const int limit = _rules.at(_combinedRules.first()).matchLimit();
+        const QString prefix = (limit > 0) ? QString("(*LIMIT_MATCH=%0)").arg(limit) : QString();
+        _combined.setPattern(prefix + alternatives.join('|'));
+    }
+
+    if (alternatives.size() <= 1 || !_combined.isValid()) {
+        _combined = QRegularExpression();
+        _combinedRules.clear();
+        _combinedGroups.clear();
+        return;
+    }
+
+    _combined.optimize();
+    _isCombined.fill(false, _rules.size());
+    for (int rule : _combinedRules) {
+        _isCombined[rule] = true;
+    }
+}
+
+const QVector<QCompiledSyntaxRule>& QSyntaxTokenizer::rules() const
+{
+    return _rules;
+}
+
+bool QSyntaxTokenizer::isCombined() const
+{
+    return !_combinedRules.isEmpty();
+}
+
+quint64 QSyntaxTokenizer::filteredCount(int rule) const
+{
+    if (_counters.isNull() || rule < 0 || rule >= _rules.size()) {
+        return 0;
+    }
+
+    return _counters->filtered[rule].loadAcquire();
+}
+
+quint64 QSyntaxTokenizer::skippedCount(int rule) const
+{
+    if (_counters.isNull() || rule < 0 || rule >= _rules.size()) {
+        return 0;
+    }
+
+    return _counters->skipped[rule].loadAcquire();
+}
+
+void QSyntaxTokenizer::resetCounters()
+{
+    for (int rule = 0; !_counters.isNull() && rule <= _rules.size(); ++rule) {
+        if (rule < _rules.size()) {
+            _counters->filtered[rule].storeRelease(0);
+            _counters->skipped[rule].storeRelease(0);
+        }
+
+        _counters->invocations[rule].storeRelease(0);
+        _counters->matches[rule].storeRelease(0);
+        _counters->bytes[rule].storeRelease(0);
+        _counters->time[rule].storeRelease(0);
+    }
+}
+
+bool QSyntaxTokenizer::isProfiling() const
+{
+    return _profiling;
+}
+
+void QSyntaxTokenizer::setProfiling(bool enabled)
+{
+    _profiling = enabled;
+}
+
+QSyntaxRuleProfile QSyntaxTokenizer::profile(int rule) const
+{
+    QSyntaxRuleProfile profile = { 0, 0, 0, 0 };
+    if (_counters.isNull() || rule < 0 || rule > _rules.size()) {
+        return profile;
+    }
+
+    profile.invocations = _counters->invocations[rule].loadAcquire();
+    profile.matches = _counters->matches[rule].loadAcquire();
+    profile.bytesScanned = _counters->bytes[rule].loadAcquire();
+    profile.time = qint64(_counters->time[rule].loadAcquire());
+    return profile;
+}
+
+QSyntaxRuleProfile QSyntaxTokenizer::combinedProfile() const
+{
+    return profile(_rules.size());
+}
+
+void QSyntaxTokenizer::record(int slot, qint64 time, int matches, int length) const
+{
+    _counters->invocations[slot].fetchAndAddRelaxed(1);
+    _counters->matches[slot].fetchAndAddRelaxed(quint64(matches));
+    _counters->bytes[slot].fetchAndAddRelaxed(quint64(length) * sizeof(QChar));
+    _counters->time[slot].fetchAndAddRelaxed(quint64(time));
+}
+
+void QSyntaxTokenizer::setLimits(int maxColumn, int blockBudget)
+{
+    _maxColumn = qMax(0, maxColumn);
+    _blockBudget = qMax(0, blockBudget);
+}
+
+QSyntaxBlockResult QSyntaxTokenizer::tokenize(const QString& text, int previousState) const
+{
+    if (_maxColumn == 0 || text.length() <= _maxColumn) {
+        return tokenizeText(text, previousState);
+    }
+
+    QSyntaxBlockResult result = tokenizeText(text.left(_maxColumn), previousState);
+    if (result.limit == QSyntaxBlockResult::NoLimit) {
+        result.limit = QSyntaxBlockResult::ColumnLimit;
+    }
+
+    return result;
+}
+
+QSyntaxBlockResult QSyntaxTokenizer::tokenizeText(const QString& text, int previousState) const
+{
+    QSyntaxBlockResult result;
+    bool exclusive = false;
+
+    QElapsedTimer timer;
+    const QElapsedTimer* clock = nullptr;
+    if (_blockBudget > 0) {
+        timer.start();
+        clock = &timer;
+    }
+
+    // the first exclusive rule that matches is the only rule of the line,
+    // unless the line continues a multi-line rule; then they are applied
+    // like all other rules.
+    const bool continues = previousState >= 0 && previousState < _rules.size();
+    if (!continues) {
+        for (int ruleIndex : _exclusiveRules) {
+            // a rule matching until the budget ran out has partial spans
+            const bool matched = tokenizeRule(ruleIndex, text, result, clock);
+            if (clock != nullptr && clock->elapsed() >= _blockBudget) {
+                result.limitRule = ruleIndex;
+                break;
+            } else if (matched) {
+                exclusive = true;
+                break;
+            }
+        }
+    }
+
+    if (isCombined() && !exclusive && result.limitRule == -1) {
+        if (_profiling) {
+            QElapsedTimer timer;
+            timer.start();
+            const int first = result.spans.size();
+            tokenizeCombined(text, result, clock);
+            record(_rules.size(), timer.nsecsElapsed(), 0, text.length());
+
+            // the matches still belong to their own rules
+            for (int i = first; i < result.spans.size(); ++i) {
+                _counters->matches[result.spans.at(i).rule].fetchAndAddRelaxed(1);
+            }
+        } else {
+            tokenizeCombined(text, result, clock);
+        }
+    }
+
+    for (int ruleIndex = 0; ruleIndex < _rules.size() && !exclusive && result.limitRule == -1; ++ruleIndex) {
+        if ((_rules.at(ruleIndex).isExclusive() && !continues) || (isCombined() && _isCombined.at(ruleIndex))) {
+            continue;
+        }
+
+        tokenizeRule(ruleIndex, text, result, clock);
+        if (clock != nullptr && clock->elapsed() >= _blockBudget) {
+            result.limitRule = ruleIndex;
+            break;
+        }
+    }
+
+    if (result.limitRule != -1) {
+        // falls back to plain text, but keeps an open multi-line rule open
+        QSyntaxBlockResult limited;
+        limited.state = continues ? previousState : -1;
+        limited.limit = QSyntaxBlockResult::BlockTimeLimit;
+        limited.limitRule = result.limitRule;
+        return limited;
+    }
+
+    // restores the order of separate scans, so that the
+    // formats override each other in the same way.
+    if (isCombined()) {
+        std::stable_sort(result.spans.begin(), result.spans.end(), lessRule);
+        std::stable_sort(result.matches.begin(), result.matches.end(), lessRule);
+    }
+
+    // if there was a multi-line-rule match in the previous block, we need to
+    // check against its closing regex.
+    if (continues) {
+        const auto& rule = _rules.at(previousState);
+        QElapsedTimer timer;
+        if (_profiling) {
+            timer.start();
+        }
+
+        QRegularExpressionMatch match = rule.closingRegex().match(text);
+        if (_profiling) {
+            record(previousState, timer.nsecsElapsed(), match.hasMatch() ? 1 : 0, text.length());
+        }
+
+        if (match.hasMatch()) {
+            // ends the multi-line regex
+            QSyntaxSpan span = { previousState, match.capturedStart(), match.capturedLength(), 0 };
+            result.spans.push_back(span);
+            if (rule.hasId()) {
+                result.matches.push_back(span);
+            }
+
+            result.state = -1;
+        } else {
+            // highlights the entire line and forwards
+            // the previous state to the next line.
+            QSyntaxSpan span = { previousState, 0, text.length(), 0 };
+            result.spans.push_back(span);
+            result.state = previousState;
+        }
+    }
+
+    return result;
+}
+
+bool QSyntaxTokenizer::tokenizeRule(int ruleIndex, const QString& text, QSyntaxBlockResult& result,
+                                    const QElapsedTimer* clock) const
+{
+    const auto& rule = _rules.at(ruleIndex);
+    if (!rule.isValid()) {
+        return false;
+    }
+
+    // the shared counters are only touched while profiling, so that the
+    // worker threads do not contend for them otherwise.
+    if (rule.hasPrefilter()) {
+        if (_profiling) {
+            _counters->filtered[ruleIndex].fetchAndAddRelaxed(1);
+        }
+
+        if (!rule.mayMatch(text)) {
+            if (_profiling) {
+                _counters->skipped[ruleIndex].fetchAndAddRelaxed(1);
+            }
+
+            return false;
+        }
+    }
+
+    if (!_profiling) {
+        return matchRule(ruleIndex, text, result, clock);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const int first = result.spans.size();
+    const bool matched = matchRule(ruleIndex, text, result, clock);
+    record(ruleIndex, timer.nsecsElapsed(), countMatches(result.spans, first), text.length());
+    return matched;
+}
+
+bool QSyntaxTokenizer::matchRule(int ruleIndex, const QString& text, QSyntaxBlockResult& result,
+                                 const QElapsedTimer* clock) const
+{
+    const auto& rule = _rules.at(ruleIndex);
+    QRegularExpressionMatch match;
+    int length = 0;
+    int start = rule.indexIn(text, 0, &length, &match);
+    if (start == -1) {
+        return false;
+    }
+
+    if (rule.isMultiLine() && result.state == -1) {
+        // before setting the multiline trigger, non-global rules
+        // check if the closing sequence is on the same line.
+        if (rule.isGlobal() || !rule.closingRegex().match(text).hasMatch()) {
+            result.state = ruleIndex;
+        }
+    }
+
+    while (start != -1) {
+        QSyntaxSpan span = { ruleIndex, start, length, 0 };
+        result.spans.push_back(span);
+        if (rule.hasId()) {
+            result.matches.push_back(span);
+        }
+
+        // the groups are formatted on top of the whole match
+        for (int group = 0; group < rule.groupCaptures().size(); ++group) {
+            const int capture = rule.groupCaptures().at(group);
+            if (match.capturedStart(capture) != -1) {
+                QSyntaxSpan groupSpan = { ruleIndex, match.capturedStart(capture), match.capturedLength(capture), group + 1 };
+                result.spans.push_back(groupSpan);
+            }
+        }
+
+        if (!rule.isGlobal() || (clock != nullptr && clock->elapsed() >= _blockBudget)) {
+            break;
+        }
+
+        // empty matches would otherwise be found over and over again
+        start = rule.indexIn(text, start + qMax(length, 1), &length, &match);
+    }
+
+    return true;
+}
+
+void QSyntaxTokenizer::tokenizeCombined(const QString& text, QSyntaxBlockResult& result,
+                                        const QElapsedTimer* clock) const
+{
+    // each merged rule continues where its own scan would continue, so that
+    // a match does not hide the matches of other rules starting within it.
+    // Rules without any of their required literals never continue.
+    const int count = _combinedRules.size();
+    QVector<int> next(count, 0);
+    for (int i = 0; i < count; ++i) {
+        if (!_rules.at(_combinedRules.at(i)).mayMatch(text)) {
+            next[i] = text.length() + 1;
+        }
+    }
+
+    int offset = *std::min_element(next.constBegin(), next.constEnd());
+    while (offset <= text.length()) {
+        QRegularExpressionMatch match = _combined.match(text, offset);
+        if (!match.hasMatch()) {
+            break;
+        }
+
+        // no rule matches before the start of the match; the alternatives
+        // before the first one that took part do not match at it either.
+        const int start = match.capturedStart();
+        int alternative = 0;
+        while (match.capturedStart(_combinedGroups.at(alternative)) == -1) {
+            next[alternative] = qMax(next.at(alternative), start + 1);
+            ++alternative;
+        }
+
+        int ruleIndex = -1;
+        for (int i = alternative; i < count; ++i) {
+            // the rule's own scan already continues after the start
+            if (next.at(i) > start) {
+                continue;
+            }
+
+            int length = match.capturedLength();
+            if (i != alternative) {
+                const QRegularExpressionMatch own = _rules.at(_combinedRules.at(i)).regex().match(
+                    text, start, QRegularExpression::NormalMatch, QRegularExpression::AnchoredMatchOption);
+                if (!own.hasMatch()) {
+                    next[i] = start + 1;
+                    continue;
+                }
+
+                length = own.capturedLength();
+            }
+
+            ruleIndex = _combinedRules.at(i);
+            QSyntaxSpan span = { ruleIndex, start, length, 0 };
+            result.spans.push_back(span);
+            if (_rules.at(ruleIndex).hasId()) {
+                result.matches.push_back(span);
+            }
+
+            // empty matches would otherwise be found over and over again
+            next[i] = start + qMax(length, 1);
+        }
+
+        if (ruleIndex != -1 && clock != nullptr && clock->elapsed() >= _blockBudget) {
+            result.limitRule = ruleIndex;
+            break;
+        }
+
+        offset = *std::min_element(next.constBegin(), next.constEnd());
+    }
+}
@@ -0,0 +1,80 @@
+/**
+ * QCodeEditor - Widget to highlight and auto-complete code.
+ * Copyright (C) 2016-2018 Nicolas Kogler
+ *
+ * QCodeEditor is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QCodeEditor. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QPlainTextDocumentLayout>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QtTest>
+
+#include <QCodeEditor/QCodeEditorChangeTracker.hpp>
+
+
+class QCodeEditorChangeTrackerTest : public QObject
+{
+private slots:
+
+    // replacing text with text of the same length does not move the
+    // revision of a document without undo, but still changes the text.
+    void replaceWithoutUndo()
+    {
+        QTextDocument document;
+        document.setDocumentLayout(new QPlainTextDocumentLayout(&document));
+        document.setUndoRedoEnabled(false);
+        document.setPlainText("first line\nsecond line");
+
+        QCodeEditorChangeTracker tracker(&document);
+        QTextCursor cursor(&document);
+        cursor.setPosition(0);
+        cursor.setPosition(5, QTextCursor::KeepAnchor);
+        cursor.insertText("FIRST");
+
+        QCOMPARE(tracker.revision(), quint64(1));
+        QCOMPARE(tracker.pendingChanges().size(), 1);
+
+        const QCodeEditorChange change = tracker.pendingChanges().first();
+        QCOMPARE(change.position, 0);
+        QCOMPARE(change.charsRemoved, 5);
+        QCOMPARE(change.charsAdded, 5);
+        QCOMPARE(change.firstBlock, 0);
+        QCOMPARE(change.lastBlock, 0);
+        QCOMPARE(change.blockDelta, 0);
+    }
+
+    // setPlainText() disables the undo stack while replacing the text
+    void setPlainTextSameLength()
+    {
+        QTextDocument document;
+        document.setDocumentLayout(new QPlainTextDocumentLayout(&document));
+        document.setPlainText("alpha");
+
+        QCodeEditorChangeTracker tracker(&document);
+        QSignalSpy spy(&tracker, SIGNAL(onChanged(QVector<QCodeEditorChange>,quint64)));
+        document.setPlainText("omega");
+        tracker.flush();
+
+        QCOMPARE(tracker.revision(), quint64(1));
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(document.toPlainText(), QString("omega"));
+    }
+
+    Q_OBJECT
+};
+
+
+QTEST_MAIN(QCodeEditorChangeTrackerTest)
+#include "QCodeEditorChangeTrackerTest.moc"